@@ -0,0 +1,254 @@
+/******************************************************************************
+ *                   ____     ______   ____     __  __                        *
+ *                  /\  _`\  /\  _  \ /\  _`\  /\ \/\ \                       *
+ *                  \ \,\L\_\\ \ \L\ \\ \,\L\_\\ \ \_\ \                      *
+ *                   \/_\__ \ \ \  __ \\/_\__ \ \ \  _  \                     *
+ *                     /\ \L\ \\ \ \/\ \ /\ \L\ \\ \ \ \ \                    *
+ *                     \ `\____\\ \_\ \_\\ `\____\\ \_\ \_\                   *
+ *                      \/_____/ \/_/\/_/ \/_____/ \/_/\/_/                   *
+ *                                                                            *
+ *                                                                            *
+ * Copyright (c) 2014                                                         *
+ * Matthias Vallentin <vallentin (at) icir.org>                               *
+ * Dominik Charousset <dominik.charousset (at) haw-hamburg.de>                *
+ *                                                                            *
+ * Distributed under the 3-clause BSD License.                                *
+ * See accompanying file LICENSE.                                             *
+\******************************************************************************/
+
+// Measures the terminal output of line editing backends. The benchmark runs
+// each backend in a child process on a pseudo terminal, types a fixed
+// editing session one keystroke at a time and waits for the screen update
+// after each keystroke. The child counts its `write(2)` calls and written
+// bytes via /proc/self/io. Each backend prints one JSON object, e.g.:
+//
+//   {"name":"redraw.termios","keystrokes":...,"writes":...,"bytes":...,
+//    "writes_per_key":...,"bytes_per_key":...}
+//
+// Usage: redraw_bench [--filter <substring>]
+
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#include <poll.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "sash/sash.hpp"
+#include "sash/termios_backend.hpp"
+
+#ifdef SASH_HAVE_EDITLINE
+#include "sash/libedit_backend.hpp"
+#endif
+
+using namespace std;
+
+namespace {
+
+using completer_type = sash::completer<sash::completion_cb>;
+
+string filter;
+
+// A keystroke is a single key press, i.e., possibly an escape sequence.
+vector<string> make_session()
+{
+  vector<string> keys;
+  auto type = [&](char const* str)
+  {
+    for (; *str != '\0'; ++str)
+      keys.emplace_back(1, *str);
+  };
+  auto repeat = [&](char const* key, size_t n)
+  {
+    for (size_t i = 0; i < n; ++i)
+      keys.emplace_back(key);
+  };
+  // Type a command, fix a typo in the middle and submit.
+  type("show connections --protocol=tpc --verbose");
+  repeat("\x1b[D", 14);
+  repeat("\x7f", 2);
+  type("cp");
+  keys.emplace_back("\x05");
+  keys.emplace_back("\r");
+  // Recall it, edit the tail and submit.
+  keys.emplace_back("\x1b[A");
+  repeat("\x7f", 9);
+  type("--brief");
+  keys.emplace_back("\x01");
+  repeat("\x1b[C", 4);
+  keys.emplace_back("\x0b");
+  type("w conns");
+  keys.emplace_back("\r");
+  // Type a line and discard it word by word.
+  type("set log-level debug");
+  repeat("\x17", 3);
+  type("help");
+  keys.emplace_back("\r");
+  return keys;
+}
+
+size_t count_lines(vector<string> const& keys)
+{
+  size_t n = 0;
+  for (auto& key : keys)
+    if (key == "\r")
+      ++n;
+  return n;
+}
+
+// Returns the value of `key` in /proc/self/io.
+size_t proc_io(char const* key)
+{
+  ifstream f{"/proc/self/io"};
+  string k;
+  size_t v;
+  while (f >> k >> v)
+    if (k.compare(0, k.size() - 1, key) == 0)
+      return v;
+  return 0;
+}
+
+// Reads all output of the child until it stays idle for `idle_ms`.
+void drain(int fd, int first_ms, int idle_ms)
+{
+  char buf[4096];
+  pollfd p{fd, POLLIN, 0};
+  auto timeout = first_ms;
+  while (::poll(&p, 1, timeout) > 0 && ::read(fd, buf, sizeof(buf)) > 0)
+    timeout = idle_ms;
+}
+
+// Runs `f(lines)` in a child on a new pseudo terminal and feeds it `keys`.
+template <class F>
+void run(char const* name, vector<string> const& keys, F f)
+{
+  if (! filter.empty() && strstr(name, filter.c_str()) == nullptr)
+    return;
+  auto master = ::posix_openpt(O_RDWR | O_NOCTTY);
+  if (master == -1 || ::grantpt(master) != 0 || ::unlockpt(master) != 0)
+  {
+    perror("posix_openpt");
+    return;
+  }
+  int results[2];
+  if (::pipe(results) != 0)
+    return;
+  auto pid = ::fork();
+  if (pid == 0)
+  {
+    ::setsid();
+    auto slave = ::open(::ptsname(master), O_RDWR);
+    ::close(master);
+    ::close(results[0]);
+    ::dup2(slave, STDIN_FILENO);
+    ::dup2(slave, STDOUT_FILENO);
+    ::close(slave);
+    auto writes = proc_io("syscw");
+    auto bytes = proc_io("wchar");
+    f(count_lines(keys));
+    writes = proc_io("syscw") - writes;
+    bytes = proc_io("wchar") - bytes;
+    auto str = to_string(writes) + " " + to_string(bytes);
+    if (::write(results[1], str.data(), str.size()) < 0)
+      _exit(1);
+    _exit(0);
+  }
+  ::close(results[1]);
+  // Wait for the prompt, then type.
+  drain(master, 1000, 20);
+  for (auto& key : keys)
+  {
+    if (::write(master, key.data(), key.size()) < 0)
+      break;
+    drain(master, 100, 2);
+  }
+  // A child that did not consume all lines would block forever.
+  char buf[64];
+  ssize_t n = 0;
+  pollfd p{results[0], POLLIN, 0};
+  if (::poll(&p, 1, 5000) > 0)
+    n = ::read(results[0], buf, sizeof(buf) - 1);
+  else
+    ::kill(pid, SIGKILL);
+  drain(master, 0, 0);
+  ::waitpid(pid, nullptr, 0);
+  ::close(results[0]);
+  ::close(master);
+  if (n <= 0)
+  {
+    cerr << name << ": session did not complete" << endl;
+    return;
+  }
+  buf[n] = '\0';
+  size_t writes = 0;
+  size_t bytes = 0;
+  if (sscanf(buf, "%zu %zu", &writes, &bytes) != 2)
+    return;
+  auto k = static_cast<double>(keys.size());
+  printf("{\"name\":\"%s\",\"keystrokes\":%zu,\"writes\":%zu,\"bytes\":%zu,"
+         "\"writes_per_key\":%.2f,\"bytes_per_key\":%.2f}\n",
+         name, keys.size(), writes, bytes, static_cast<double>(writes) / k,
+         static_cast<double>(bytes) / k);
+  fflush(stdout);
+}
+
+template <class Backend>
+void session(Backend& backend, size_t lines)
+{
+  backend.set_prompt("sash", sash::color::blue);
+  backend.add_to_prompt(" > ");
+  string line;
+  for (size_t i = 0; i < lines && backend.read_line(line); ++i)
+    backend.history_enter(line);
+  backend.reset();
+}
+
+void bench_termios(vector<string> const& keys)
+{
+  run("redraw.termios", keys, [](size_t lines)
+  {
+    sash::termios_backend<completer_type> backend{"redraw_bench"};
+    session(backend, lines);
+  });
+}
+
+void bench_libedit(vector<string> const& keys)
+{
+#ifdef SASH_HAVE_EDITLINE
+  run("redraw.libedit", keys, [](size_t lines)
+  {
+    sash::libedit_backend<completer_type> backend{"redraw_bench"};
+    session(backend, lines);
+  });
+#else
+  static_cast<void>(keys);
+#endif
+}
+
+} // namespace <anonymous>
+
+int main(int argc, char** argv)
+{
+  for (int i = 1; i < argc; ++i)
+  {
+    if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc)
+    {
+      filter = argv[++i];
+    }
+    else
+    {
+      cerr << "usage: " << argv[0] << " [--filter <substring>]" << endl;
+      return 1;
+    }
+  }
+  auto keys = make_session();
+  bench_termios(keys);
+  bench_libedit(keys);
+}
@@ -0,0 +1,648 @@
+/******************************************************************************
+ *                   ____     ______   ____     __  __                        *
+ *                  /\  _`\  /\  _  \ /\  _`\  /\ \/\ \                       *
+ *                  \ \,\L\_\\ \ \L\ \\ \,\L\_\\ \ \_\ \                      *
+ *                   \/_\__ \ \ \  __ \\/_\__ \ \ \  _  \                     *
+ *                     /\ \L\ \\ \ \/\ \ /\ \L\ \\ \ \ \ \                    *
+ *                     \ `\____\\ \_\ \_\\ `\____\\ \_\ \_\                   *
+ *                      \/_____/ \/_/\/_/ \/_____/ \/_/\/_/                   *
+ *                                                                            *
+ *                                                                            *
+ * Copyright (c) 2014                                                         *
+ * Matthias Vallentin <vallentin (at) icir.org>                               *
+ * Dominik Charousset <dominik.charousset (at) haw-hamburg.de>                *
+ *                                                                            *
+ * Distributed under the 3-clause BSD License.                                *
+ * See accompanying file LICENSE.                                             *
+\******************************************************************************/
+
+// Microbenchmarks for the hot paths of sash. Each benchmark prints one JSON
+// object per line, e.g.:
+//
+//   {"name":"completer.complete","entries":1000,"iterations":...,
+//    "samples":5,"ns_per_op":...,"min_ns_per_op":...}
+//
+// where `ns_per_op` is the median over all samples. Inputs are generated
+// from a fixed seed, i.e., runs are reproducible across releases.
+//
+// Usage: sash_bench [--filter <substring>] [--samples <n>]
+
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <algorithm>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "sash/sash.hpp"
+#include "sash/completer.hpp"
+#include "sash/output_queue.hpp"
+#include "sash/dynamic_prompt.hpp"
+#include "sash/memory_backend.hpp"
+#include "sash/path_completer.hpp"
+#include "sash/shared_history.hpp"
+#include "sash/completion_provider.hpp"
+#include "sash/preprocessor_chain.hpp"
+#include "sash/variables_engine.hpp"
+
+#ifdef SASH_HAVE_EDITLINE
+#include "sash/libedit_backend.hpp"
+#endif
+
+using namespace std;
+
+namespace {
+
+using char_iter = string::const_iterator;
+
+using cli_type = sash::sash<sash::memory_backend>::type;
+
+using completer_type = sash::completer<sash::completion_cb>;
+
+using command_type = sash::command<completer_type, sash::command_cb>;
+
+string filter;
+
+size_t num_samples = 5;
+
+// Prevents the compiler from optimizing away computations on `x`.
+template <class T>
+void keep(T const& x)
+{
+  asm volatile("" : : "r"(&x) : "memory");
+}
+
+// Runs `f(n)` with increasing `n` until one sample takes at least 20ms,
+// then reports the median and minimum time per iteration over all samples.
+// @param params Additional JSON members describing the parameters.
+template <class F>
+void run(char const* name, string const& params, F f)
+{
+  if (! filter.empty() && strstr(name, filter.c_str()) == nullptr)
+    return;
+  using clock = chrono::steady_clock;
+  auto measure = [&](size_t n) -> double
+  {
+    auto t0 = clock::now();
+    f(n);
+    return chrono::duration<double, nano>(clock::now() - t0).count();
+  };
+  size_t n = 1;
+  while (measure(n) < 20e6 && n < (size_t{1} << 32))
+    n *= 2;
+  vector<double> xs;
+  for (size_t i = 0; i < num_samples; ++i)
+    xs.push_back(measure(n) / static_cast<double>(n));
+  sort(xs.begin(), xs.end());
+  printf("{\"name\":\"%s\"%s%s,\"iterations\":%zu,\"samples\":%zu,"
+         "\"ns_per_op\":%.2f,\"min_ns_per_op\":%.2f}\n",
+         name, params.empty() ? "" : ",", params.c_str(), n, xs.size(),
+         xs[xs.size() / 2], xs.front());
+  fflush(stdout);
+}
+
+string param(char const* key, size_t value)
+{
+  return string{"\""} + key + "\":" + to_string(value);
+}
+
+// Generates `n` distinct words of 4 to 12 lowercase letters.
+vector<string> make_words(size_t n)
+{
+  mt19937 rng{42};
+  uniform_int_distribution<int> len{4, 12};
+  uniform_int_distribution<int> chr{'a', 'z'};
+  vector<string> result;
+  result.reserve(n);
+  for (size_t i = 0; i < n; ++i)
+  {
+    string str(static_cast<size_t>(len(rng)), ' ');
+    for (auto& c : str)
+      c = static_cast<char>(chr(rng));
+    result.push_back(str + to_string(i));
+  }
+  return result;
+}
+
+void bench_completer()
+{
+  for (size_t entries : {size_t{1000}, size_t{100000}, size_t{1000000}})
+  {
+    auto words = make_words(entries);
+    vector<string> prefixes;
+    for (size_t i = 0; i < 64; ++i)
+      prefixes.push_back(words[(i * 7919) % words.size()].substr(0, 3));
+    completer_type comp;
+    comp.replace_completions(words);
+    comp.on_completion([](string const&, vector<string> matches) -> string
+    {
+      return matches.empty() ? string{} : matches.front();
+    });
+    run("completer.complete", param("entries", entries), [&](size_t n)
+    {
+      string result;
+      for (size_t i = 0; i < n; ++i)
+      {
+        comp.complete(result, prefixes[i % prefixes.size()]);
+        keep(result);
+      }
+    });
+  }
+}
+
+// Measures completions served from the cache of an asynchronous provider,
+// i.e., the cost on the thread running the command line.
+void bench_completion_provider()
+{
+  auto words = make_words(1000);
+  sash::async_completion_provider provider{
+    [&](string const&, vector<string>& out)
+    {
+      out = words;
+      return true;
+    },
+    chrono::seconds(1), chrono::hours(1)};
+  provider.get("");
+  string line = "attach " + words[500].substr(0, 2);
+  run("completion_provider.hit", param("entries", words.size()),
+      [&](size_t n)
+      {
+        for (size_t i = 0; i < n; ++i)
+        {
+          auto xs = provider(line.begin(), line.end());
+          keep(xs);
+        }
+      });
+}
+
+// Compares path completion from the cached listing with reading the
+// directory on each completion.
+void bench_path_completer()
+{
+  char tmpl[] = "/tmp/sash_bench_dir_XXXXXX";
+  if (mkdtemp(tmpl) == nullptr)
+    return;
+  string dir = tmpl;
+  auto words = make_words(10000);
+  for (auto& w : words)
+  {
+    auto fd = ::open((dir + "/" + w).c_str(), O_CREAT | O_WRONLY, 0600);
+    if (fd != -1)
+      close(fd);
+  }
+  auto prefix = dir + "/" + words[500].substr(0, 2);
+  for (bool cached : {true, false})
+  {
+    sash::path_completer paths;
+    run("path_completer.complete",
+        param("entries", words.size()) + ",\"cached\":"
+        + (cached ? "true" : "false"),
+        [&](size_t n)
+        {
+          for (size_t i = 0; i < n; ++i)
+          {
+            if (! cached)
+              paths.clear();
+            auto xs = paths.complete(prefix);
+            keep(xs);
+          }
+        });
+  }
+  for (auto& w : words)
+    unlink((dir + "/" + w).c_str());
+  rmdir(tmpl);
+}
+
+void bench_execute()
+{
+  size_t shapes[][2] = {{1, 4}, {1, 64}, {1, 1024},
+                        {4, 4}, {4, 64}, {16, 4}, {16, 64}};
+  for (auto& shape : shapes)
+  {
+    auto depth = shape[0];
+    auto fan_out = shape[1];
+    auto comp = make_shared<completer_type>();
+    auto root = make_shared<command_type>(nullptr, comp, "root", "");
+    // Only the last child of each level has children, i.e., dispatching
+    // `line` looks up the last sibling in the index of each level.
+    string line;
+    auto parent = root;
+    for (size_t level = 0; level < depth; ++level)
+    {
+      for (size_t i = 0; i < fan_out; ++i)
+      {
+        auto cmd = parent->add("cmd" + to_string(i), "");
+        if (i + 1 == fan_out)
+          parent = cmd;
+      }
+      line += "cmd" + to_string(fan_out - 1) + " ";
+    }
+    line += "arg";
+    parent->on([](string&, char_iter, char_iter) { return sash::executed; });
+    run("command.execute",
+        param("depth", depth) + "," + param("fan_out", fan_out),
+        [&](size_t n)
+        {
+          string err;
+          for (size_t i = 0; i < n; ++i)
+          {
+            auto res = root->execute(err, line);
+            keep(res);
+          }
+        });
+  }
+}
+
+// Measures dispatching to a handler with typed arguments, including parsing
+// and validating them.
+void bench_arguments()
+{
+  namespace arg = sash::arg;
+  auto comp = make_shared<completer_type>();
+  auto root = make_shared<command_type>(nullptr, comp, "root", "");
+  root->add("connect", "",
+            {arg::word("host"), arg::integer("port", 1, 65535),
+             arg::choice("proto", {"tcp", "udp"}), arg::duration("timeout")},
+            [](string&, sash::argument_pack const& args)
+            {
+              keep(args);
+              return sash::executed;
+            });
+  string line = "connect localhost 8080 udp 250ms";
+  run("command.execute_typed", param("arguments", 4), [&](size_t n)
+  {
+    string err;
+    for (size_t i = 0; i < n; ++i)
+    {
+      auto res = root->execute(err, line);
+      keep(res);
+    }
+  });
+}
+
+// Compares invoking a handler that renders a table of 100 rows with
+// replaying the cached output of a previous call.
+void bench_cached_results()
+{
+  for (bool cached : {false, true})
+  {
+    auto comp = make_shared<completer_type>();
+    auto root = make_shared<command_type>(nullptr, comp, "root", "");
+    auto cmd = root->add("show", "");
+    cmd->on([](string&, char_iter first, char_iter last)
+    {
+      auto& out = sash::output();
+      for (int row = 0; row < 100; ++row)
+      {
+        out.write(&*first, last - first);
+        out << ' ' << row << ' ' << row * 0.5 << '\n';
+      }
+      return sash::executed;
+    });
+    if (cached)
+      cmd->cache_results(chrono::hours(1));
+    string line = "show topology of cluster one";
+    string out;
+    sash::string_writer buf{out};
+    ostream os{&buf};
+    sash::io_redirect guard{&os, nullptr};
+    run("command.execute_cached", string{"\"cached\":"}
+                                  + (cached ? "true" : "false"),
+        [&](size_t n)
+        {
+          string err;
+          for (size_t i = 0; i < n; ++i)
+          {
+            out.clear();
+            auto res = root->execute(err, line);
+            keep(res);
+          }
+        });
+  }
+}
+
+// Posts a burst of messages from two sources, one of them rate-limited,
+// and coalesces them into a single frame.
+void bench_output_queue()
+{
+  for (size_t burst : {8, 64})
+  {
+    sash::output_queue q{chrono::milliseconds{0}, 4096};
+    q.rate_limit("flood", 1e6, burst / 2);
+    string msg = "job 42 finished with exit code 0";
+    string out;
+    run("output_queue.frame", param("messages", burst), [&](size_t n)
+    {
+      for (size_t i = 0; i < n; ++i)
+      {
+        for (size_t j = 0; j < burst; ++j)
+          q.post(j % 2 == 0 ? "jobs" : "flood", msg);
+        out.clear();
+        keep(q.take(out));
+      }
+    });
+  }
+}
+
+// Renders a prompt with three segments, either unchanged or with one
+// dirty segment, and compares it to concatenating the prompt every time.
+void bench_prompt()
+{
+  size_t latency = 0;
+  string leader = "node-17.cluster.local";
+  sash::dynamic_prompt p;
+  p.add_text("config", sash::color::blue);
+  p.add([&](string& str) { str = leader; }, sash::color::grey);
+  auto id = p.add([&](string& str)
+  {
+    str = " ";
+    str += to_string(latency);
+    str += "us> ";
+  });
+  for (bool dirty : {false, true})
+  {
+    run("prompt.render", string{"\"dirty\":"} + (dirty ? "true" : "false"),
+        [&](size_t n)
+        {
+          for (size_t i = 0; i < n; ++i)
+          {
+            if (dirty)
+            {
+              ++latency;
+              p.invalidate(id);
+            }
+            keep(p.render());
+          }
+        });
+  }
+  run("prompt.concat", "", [&](size_t n)
+  {
+    for (size_t i = 0; i < n; ++i)
+    {
+      string str;
+      str += sash::color::blue;
+      str += "config";
+      str += sash::color::reset;
+      str += sash::color::grey;
+      str += leader;
+      str += sash::color::reset;
+      str += " " + to_string(++latency) + "us> ";
+      keep(str);
+    }
+  });
+}
+
+// Formats the help of a mode with 64 commands.
+void bench_help()
+{
+  cli_type cli;
+  auto m = cli.mode_add("default", "> ");
+  cli.mode_push("default");
+  for (auto& w : make_words(64))
+    m->add(w, "a command named " + w);
+  run("mode.help", param("commands", 64), [&](size_t n)
+  {
+    for (size_t i = 0; i < n; ++i)
+      keep(cli.current_mode().help(2));
+  });
+}
+
+void bench_mode_chain()
+{
+  using mode_type = sash::mode<sash::memory_backend<completer_type>,
+                               command_type>;
+  for (size_t depth : {size_t{1}, size_t{4}, size_t{16}})
+  {
+    // Each mode has 16 commands and the line selects a command of the
+    // outermost ancestor.
+    vector<shared_ptr<mode_type>> chain;
+    for (size_t i = 0; i < depth; ++i)
+    {
+      auto m = make_shared<mode_type>("mode" + to_string(i), "");
+      for (size_t j = 0; j < 16; ++j)
+        m->add("cmd" + to_string(i) + "_" + to_string(j), "",
+               [](string&, char_iter, char_iter) { return sash::executed; });
+      if (! chain.empty())
+        chain.back()->parent(m);
+      chain.push_back(m);
+    }
+    string line = "cmd" + to_string(depth - 1) + "_15 arg";
+    run("mode.execute", param("depth", depth), [&](size_t n)
+    {
+      string err;
+      for (size_t i = 0; i < n; ++i)
+      {
+        auto res = chain.front()->execute(err, line);
+        keep(res);
+      }
+    });
+  }
+}
+
+void bench_variables()
+{
+  auto engine = sash::variables_engine<>::create();
+  engine->set("host", "localhost");
+  engine->set("port", "8080");
+  struct input
+  {
+    char const* name;
+    string line;
+  };
+  input inputs[] = {
+    {"none", "connect localhost 8080 --timeout 30 --retries 5"},
+    {"two", "connect $host ${port} --timeout 30 --retries 5"}
+  };
+  for (auto& x : inputs)
+  {
+    run("variables_engine.parse", string{"\"variables\":\""} + x.name + "\"",
+        [&](size_t n)
+        {
+          string err;
+          string out;
+          for (size_t i = 0; i < n; ++i)
+          {
+            out.clear();
+            engine->parse(err, x.line, out);
+            keep(out);
+          }
+        });
+  }
+}
+
+void bench_process()
+{
+  for (size_t num_preprocessors : {size_t{0}, size_t{1}, size_t{4}})
+  for (bool with_stats : {false, true})
+  {
+    cli_type cli;
+    cli.set_interruptible(false);
+    if (with_stats)
+      cli.enable_stats();
+    auto mptr = cli.mode_add("default", "> ");
+    cli.mode_push("default");
+    mptr->add("set", "")->add("value", "")->on(
+      [](string&, char_iter, char_iter) { return sash::executed; });
+    if (num_preprocessors > 0)
+    {
+      auto engine = sash::variables_engine<>::create();
+      engine->set("x", "42");
+      cli.add_preprocessor(engine->as_functor());
+    }
+    for (size_t i = 1; i < num_preprocessors; ++i)
+      cli.add_preprocessor([](string&, string const& in, string& out)
+      {
+        out = in;
+      });
+    string line = "set value $x";
+    run("command_line.process",
+        param("preprocessors", num_preprocessors) + ",\"stats\":"
+        + (with_stats ? "true" : "false"),
+        [&](size_t n)
+        {
+          for (size_t i = 0; i < n; ++i)
+          {
+            auto res = cli.process(line);
+            keep(res);
+          }
+        });
+  }
+}
+
+// A stage that inspects the line without changing it.
+struct passthrough_stage
+{
+  sash::preprocess_result operator()(string& err, string const& in,
+                                     string&) const
+  {
+    if (in.empty())
+      err = "empty line";
+    return sash::line_unchanged;
+  }
+};
+
+void bench_process_chain()
+{
+  using engine_type = sash::variables_engine<>;
+  using chain_type = sash::preprocessor_chain<engine_type::stage,
+                                              passthrough_stage,
+                                              passthrough_stage,
+                                              passthrough_stage>;
+  using chain_cli_type = sash::sash<sash::memory_backend, sash::completion_cb,
+                                    sash::command_cb, chain_type>::type;
+  for (auto line : {"set value 42", "set value $x"})
+  {
+    chain_cli_type cli;
+    cli.set_interruptible(false);
+    auto mptr = cli.mode_add("default", "> ");
+    cli.mode_push("default");
+    mptr->add("set", "")->add("value", "")->on(
+      [](string&, char_iter, char_iter) { return sash::executed; });
+    auto engine = engine_type::create();
+    engine->set("x", "42");
+    cli.add_preprocessor(chain_type{engine->as_stage(), passthrough_stage{},
+                                    passthrough_stage{}, passthrough_stage{}});
+    string str = line;
+    run("command_line.process_chain",
+        string{"\"preprocessors\":4,\"variables\":"}
+        + (str.find('$') == string::npos ? "false" : "true"),
+        [&](size_t n)
+        {
+          for (size_t i = 0; i < n; ++i)
+          {
+            auto res = cli.process(str);
+            keep(res);
+          }
+        });
+  }
+}
+
+void bench_history()
+{
+  auto words = make_words(4096);
+  sash::memory_backend<completer_type> mem{"bench", "", 1000};
+  run("history.add", "\"backend\":\"memory\"", [&](size_t n)
+  {
+    for (size_t i = 0; i < n; ++i)
+      mem.history_add(words[i % words.size()]);
+  });
+  char tmpl[] = "/tmp/sash_bench_XXXXXX";
+  auto fd = mkstemp(tmpl);
+  if (fd == -1)
+    return;
+  close(fd);
+  {
+    sash::shared_history shared{tmpl, false};
+    auto nop = [](string const&) { };
+    run("history.append", "\"backend\":\"shared\"", [&](size_t n)
+    {
+      for (size_t i = 0; i < n; ++i)
+        shared.append(words[i % words.size()], nop);
+    });
+  }
+#ifdef SASH_HAVE_EDITLINE
+  sash::libedit_backend<completer_type> el{"bench", tmpl, 1000, false};
+  run("history.add", "\"backend\":\"libedit\"", [&](size_t n)
+  {
+    for (size_t i = 0; i < n; ++i)
+      el.history_add(words[i % words.size()]);
+  });
+  for (size_t entries : {size_t{100}, size_t{1000}})
+  {
+    sash::libedit_backend<completer_type> full{"bench", tmpl,
+                                               static_cast<int>(entries),
+                                               false};
+    for (size_t i = 0; i < entries; ++i)
+      full.history_add(words[i]);
+    run("history.save", param("entries", entries), [&](size_t n)
+    {
+      for (size_t i = 0; i < n; ++i)
+        full.history_save();
+    });
+  }
+#endif
+  unlink(tmpl);
+}
+
+} // namespace <anonymous>
+
+int main(int argc, char** argv)
+{
+  for (int i = 1; i < argc; ++i)
+  {
+    if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc)
+    {
+      filter = argv[++i];
+    }
+    else if (strcmp(argv[i], "--samples") == 0 && i + 1 < argc)
+    {
+      num_samples = max(strtoul(argv[++i], nullptr, 10), 1ul);
+    }
+    else
+    {
+      cerr << "usage: " << argv[0]
+           << " [--filter <substring>] [--samples <n>]" << endl;
+      return 1;
+    }
+  }
+  bench_completer();
+  bench_completion_provider();
+  bench_path_completer();
+  bench_execute();
+  bench_arguments();
+  bench_cached_results();
+  bench_output_queue();
+  bench_prompt();
+  bench_help();
+  bench_mode_chain();
+  bench_variables();
+  bench_process();
+  bench_process_chain();
+  bench_history();
+}
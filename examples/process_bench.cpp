@@ -0,0 +1,99 @@
+/******************************************************************************
+ *                   ____     ______   ____     __  __                        *
+ *                  /\  _`\  /\  _  \ /\  _`\  /\ \/\ \                       *
+ *                  \ \,\L\_\\ \ \L\ \\ \,\L\_\\ \ \_\ \                      *
+ *                   \/_\__ \ \ \  __ \\/_\__ \ \ \  _  \                     *
+ *                     /\ \L\ \\ \ \/\ \ /\ \L\ \\ \ \ \ \                    *
+ *                     \ `\____\\ \_\ \_\\ `\____\\ \_\ \_\                   *
+ *                      \/_____/ \/_/\/_/ \/_____/ \/_/\/_/                   *
+ *                                                                            *
+ *                                                                            *
+ * Copyright (c) 2014                                                         *
+ * Matthias Vallentin <vallentin (at) icir.org>                               *
+ * Dominik Charousset <dominik.charousset (at) haw-hamburg.de>                *
+ *                                                                            *
+ * Distributed under the 3-clause BSD License.                                *
+ * See accompanying file LICENSE.                                             *
+\******************************************************************************/
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdlib>
+#include <iostream>
+
+#include "sash/sash.hpp"
+#include "sash/session_backend.hpp"
+#include "sash/variables_engine.hpp"
+
+using namespace std;
+
+// Measures the throughput of command_line::process with 1 to N threads, each
+// thread using its own execution context. Prints one line per thread count.
+int main(int argc, char** argv)
+{
+  using char_iter = string::const_iterator;
+  using cli_type = sash::sash<sash::session_backend>::type;
+  auto max_threads = argc > 1 ? strtoul(argv[1], nullptr, 10)
+                              : max(thread::hardware_concurrency(), 1u);
+  auto duration = chrono::milliseconds{argc > 2 ? atoi(argv[2]) : 500};
+  cli_type cli;
+  auto mptr = cli.mode_add("default", "> ");
+  cli.add_preprocessor(sash::variables_engine<>::create_functor());
+  auto sum = mptr->add("sum", "adds numbers");
+  sum->on([](string& err, char_iter first, char_iter last)
+          -> sash::command_result
+  {
+    long result = 0;
+    while (first != last)
+    {
+      auto i = find(first, last, ' ');
+      result += strtol(string(first, i).c_str(), nullptr, 10);
+      first = i == last ? last : i + 1;
+    }
+    if (result != 6)
+    {
+      err = "sum: wrong result";
+      return sash::no_command;
+    }
+    return sash::executed;
+  });
+  cout << "threads,commands_per_sec,speedup" << endl;
+  double base = 0;
+  for (size_t n = 1; n <= max_threads; ++n)
+  {
+    atomic<bool> stop{false};
+    atomic<uint64_t> total{0};
+    vector<thread> threads;
+    for (size_t i = 0; i < n; ++i)
+      threads.emplace_back([&]
+      {
+        auto ctx = cli.make_context("default");
+        string cmd = "sum 1 2 3";
+        uint64_t count = 0;
+        while (! stop.load(memory_order_relaxed))
+        {
+          if (cli.process(ctx, cmd) != sash::executed)
+          {
+            cerr << ctx.error << endl;
+            abort();
+          }
+          ++count;
+        }
+        total += count;
+      });
+    auto start = chrono::steady_clock::now();
+    this_thread::sleep_for(duration);
+    stop = true;
+    for (auto& t : threads)
+      t.join();
+    auto secs = chrono::duration<double>(chrono::steady_clock::now() - start);
+    auto rate = total / secs.count();
+    if (n == 1)
+      base = rate;
+    cout << n << "," << static_cast<uint64_t>(rate) << "," << rate / base
+         << endl;
+  }
+}
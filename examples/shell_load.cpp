@@ -0,0 +1,166 @@
+/******************************************************************************
+ *                   ____     ______   ____     __  __                        *
+ *                  /\  _`\  /\  _  \ /\  _`\  /\ \/\ \                       *
+ *                  \ \,\L\_\\ \ \L\ \\ \,\L\_\\ \ \_\ \                      *
+ *                   \/_\__ \ \ \  __ \\/_\__ \ \ \  _  \                     *
+ *                     /\ \L\ \\ \ \/\ \ /\ \L\ \\ \ \ \ \                    *
+ *                     \ `\____\\ \_\ \_\\ `\____\\ \_\ \_\                   *
+ *                      \/_____/ \/_/\/_/ \/_____/ \/_/\/_/                   *
+ *                                                                            *
+ *                                                                            *
+ * Copyright (c) 2014                                                         *
+ * Matthias Vallentin <vallentin (at) icir.org>                               *
+ * Dominik Charousset <dominik.charousset (at) haw-hamburg.de>                *
+ *                                                                            *
+ * Distributed under the 3-clause BSD License.                                *
+ * See accompanying file LICENSE.                                             *
+\******************************************************************************/
+
+#include <chrono>
+#include <string>
+#include <vector>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+
+using namespace std;
+
+namespace {
+
+struct session
+{
+  int fd;
+  size_t remaining;
+  string in;
+};
+
+int connect_to(string const& path)
+{
+  sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+  auto fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd == -1)
+    return -1;
+  if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0)
+  {
+    close(fd);
+    return -1;
+  }
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+  return fd;
+}
+
+bool ends_with(string const& str, string const& suffix)
+{
+  return str.size() >= suffix.size()
+         && str.compare(str.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+} // namespace <anonymous>
+
+// Opens many sessions to a shell_server and runs commands in all of them
+// concurrently. Each session sends its next command after receiving the
+// prompt of the previous one.
+int main(int argc, char** argv)
+{
+  if (argc > 1
+      && (strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0))
+  {
+    cout << "usage: " << argv[0]
+         << " [socket] [sessions] [commands per session] [command] [prompt]"
+         << endl;
+    return 0;
+  }
+  string path = argc > 1 ? argv[1] : "/tmp/sash.sock";
+  size_t num_sessions = argc > 2 ? strtoul(argv[2], nullptr, 10) : 1000;
+  size_t num_commands = argc > 3 ? strtoul(argv[3], nullptr, 10) : 100;
+  string cmd = argc > 4 ? argv[4] : "echo hello";
+  string prompt = argc > 5 ? argv[5] : "SASH> ";
+  cmd += '\n';
+  auto epfd = epoll_create1(EPOLL_CLOEXEC);
+  vector<session> sessions;
+  sessions.reserve(num_sessions);
+  for (size_t i = 0; i < num_sessions; ++i)
+  {
+    auto fd = connect_to(path);
+    if (fd == -1)
+    {
+      cerr << "cannot connect session " << i << " to " << path << ": "
+           << strerror(errno) << endl;
+      return 1;
+    }
+    sessions.push_back(session{fd, num_commands, string{}});
+  }
+  for (size_t i = 0; i < num_sessions; ++i)
+  {
+    epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.u64 = i;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, sessions[i].fd, &ev);
+  }
+  size_t done = 0;
+  size_t executed = 0;
+  auto start = chrono::steady_clock::now();
+  vector<epoll_event> events(1024);
+  char buf[4096];
+  while (done < num_sessions)
+  {
+    auto n = epoll_wait(epfd, events.data(), static_cast<int>(events.size()),
+                        -1);
+    if (n < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      cerr << "epoll_wait: " << strerror(errno) << endl;
+      return 1;
+    }
+    for (int i = 0; i < n; ++i)
+    {
+      auto& s = sessions[events[i].data.u64];
+      ssize_t rd;
+      while ((rd = read(s.fd, buf, sizeof(buf))) > 0)
+        s.in.append(buf, static_cast<size_t>(rd));
+      if (rd == 0 || (rd < 0 && errno != EAGAIN && errno != EINTR))
+      {
+        cerr << "session closed by server" << endl;
+        return 1;
+      }
+      if (! ends_with(s.in, prompt))
+        continue;
+      if (s.in.size() != prompt.size())
+        ++executed; // not the initial prompt
+      s.in.clear();
+      if (s.remaining == 0)
+      {
+        epoll_ctl(epfd, EPOLL_CTL_DEL, s.fd, nullptr);
+        close(s.fd);
+        ++done;
+        continue;
+      }
+      --s.remaining;
+      // Commands are short, i.e., the socket buffer never fills up here.
+      auto n = write(s.fd, cmd.data(), cmd.size());
+      if (n != static_cast<ssize_t>(cmd.size()))
+      {
+        cerr << "write: " << strerror(errno) << endl;
+        return 1;
+      }
+    }
+  }
+  auto secs = chrono::duration<double>(chrono::steady_clock::now() - start);
+  close(epfd);
+  cout << "sessions: " << num_sessions << endl
+       << "commands: " << executed << endl
+       << "seconds: " << secs.count() << endl
+       << "commands/sec: " << static_cast<size_t>(executed / secs.count())
+       << endl;
+}
@@ -0,0 +1,112 @@
+/******************************************************************************
+ *                   ____     ______   ____     __  __                        *
+ *                  /\  _`\  /\  _  \ /\  _`\  /\ \/\ \                       *
+ *                  \ \,\L\_\\ \ \L\ \\ \,\L\_\\ \ \_\ \                      *
+ *                   \/_\__ \ \ \  __ \\/_\__ \ \ \  _  \                     *
+ *                     /\ \L\ \\ \ \/\ \ /\ \L\ \\ \ \ \ \                    *
+ *                     \ `\____\\ \_\ \_\\ `\____\\ \_\ \_\                   *
+ *                      \/_____/ \/_/\/_/ \/_____/ \/_/\/_/                   *
+ *                                                                            *
+ *                                                                            *
+ * Copyright (c) 2014                                                         *
+ * Matthias Vallentin <vallentin (at) icir.org>                               *
+ * Dominik Charousset <dominik.charousset (at) haw-hamburg.de>                *
+ *                                                                            *
+ * Distributed under the 3-clause BSD License.                                *
+ * See accompanying file LICENSE.                                             *
+\******************************************************************************/
+
+#include <csignal>
+#include <iostream>
+#include <iterator>
+
+#include "sash/sash.hpp"
+#include "sash/pipeline.hpp"
+#include "sash/session_server.hpp"
+#include "sash/session_backend.hpp"
+#include "sash/variables_engine.hpp"
+
+using namespace std;
+
+namespace {
+
+using cli_type = sash::sash<sash::session_backend>::type;
+
+sash::session_server<cli_type>* server_ptr = nullptr;
+
+void on_signal(int)
+{
+  if (server_ptr != nullptr)
+    server_ptr->stop();
+}
+
+} // namespace <anonymous>
+
+// Serves a shell over a Unix domain socket, try: socat - UNIX:/tmp/sash.sock
+int main(int argc, char** argv)
+{
+  using char_iter = string::const_iterator;
+  using sash::command_result;
+  string path = argc > 1 ? argv[1] : "/tmp/sash.sock";
+  // All sessions share this mode, i.e., its commands and completions.
+  auto mptr = make_shared<cli_type::mode_type>("default", "", 1000, true,
+                                               "SASH> ");
+  sash::session_server<cli_type> server{[&](cli_type& cli)
+  {
+    cli.mode_add(mptr);
+    cli.mode_push("default");
+    cli.add_preprocessor(sash::variables_engine<>::create_functor());
+  }};
+  mptr->add_all({
+    {
+      "quit", "closes the session",
+      [&](string& err, char_iter first, char_iter last) -> command_result
+      {
+        if (first == last)
+        {
+          server.close_session();
+          return sash::executed;
+        }
+        err = "quit: too many arguments (none expected)";
+        return sash::no_command;
+      }
+    },
+    {
+      "echo", "prints its arguments",
+      [](string&, char_iter first, char_iter last) -> command_result
+      {
+        auto& out = sash::output();
+        copy(first, last, ostream_iterator<char>(out));
+        out << '\n';
+        return sash::executed;
+      }
+    },
+    {
+      "sessions", "prints the number of open sessions",
+      [&](string&, char_iter, char_iter) -> command_result
+      {
+        sash::output() << server.num_sessions() << '\n';
+        return sash::executed;
+      }
+    },
+    {
+      "help", "prints this text",
+      [&](string&, char_iter, char_iter) -> command_result
+      {
+        sash::output() << mptr->help();
+        return sash::executed;
+      }
+    }});
+  string err;
+  if (! server.listen(path, err))
+  {
+    cerr << err << endl;
+    return 1;
+  }
+  server_ptr = &server;
+  signal(SIGINT, on_signal);
+  signal(SIGTERM, on_signal);
+  cout << "listening on " << path << endl;
+  server.run();
+  cout << "served " << server.num_commands() << " commands" << endl;
+}
@@ -16,9 +16,13 @@
  * See accompanying file LICENSE.                                             *
 \******************************************************************************/
 
+#include <chrono>
 #include <iostream>
 
 #include "sash/sash.hpp"
+#include "sash/pipeline.hpp"
+#include "sash/output_queue.hpp"
+#include "sash/dynamic_prompt.hpp"
 #include "sash/libedit_backend.hpp" // our backend
 #include "sash/variables_engine.hpp"
 
@@ -32,6 +36,21 @@ int main()
   string line;
   auto mptr = cli.mode_add("default", "SASH> ");
   cli.mode_push("default");
+  // The prompt shows the latency of the last command. Its segment is only
+  // recomputed after running a command.
+  chrono::microseconds latency{0};
+  auto prompt = make_shared<sash::dynamic_prompt>();
+  prompt->add_text("SASH");
+  auto latency_segment = prompt->add([&](string& str)
+  {
+    str.clear();
+    if (latency.count() > 0)
+      str = " " + to_string(latency.count()) + "us";
+  }, sash::color::grey);
+  prompt->add_text("> ");
+  mptr->backend().set_prompt(prompt);
+  // Background jobs report above the prompt as soon as they finish.
+  cli.set_output_queue(make_shared<sash::output_queue>());
   cli.add_preprocessor(sash::variables_engine<>::create_functor());
   bool done = false;
   mptr->add_all({
@@ -52,8 +71,27 @@ int main()
       "echo", "prints its arguments",
       [](string&, char_iter first, char_iter last) -> command_result
       {
-        copy(first, last, ostream_iterator<char>(cout));
-        cout << endl;
+        auto& out = sash::output();
+        copy(first, last, ostream_iterator<char>(out));
+        out << endl;
+        return sash::executed;
+      }
+    },
+    {
+      "grep", "prints lines of its input containing the argument",
+      [](string& err, char_iter first, char_iter last) -> command_result
+      {
+        auto in = sash::input();
+        if (in == nullptr)
+        {
+          err = "grep: no input (use as pipeline stage)";
+          return sash::no_command;
+        }
+        string pattern(first, last);
+        string line;
+        while (getline(*in, line))
+          if (line.find(pattern) != string::npos)
+            sash::output() << line << endl;
         return sash::executed;
       }
     },
@@ -72,9 +110,17 @@ int main()
         return sash::no_command;
       }
     }});
+  mptr->add_all(cli.job_commands());
+  cli.enable_stats();
+  mptr->add_all({cli.stats_command()});
   while (!done && cli.read_line(line))
   {
-    switch (cli.process(line))
+    auto start = chrono::steady_clock::now();
+    auto result = cli.process(line);
+    latency = chrono::duration_cast<chrono::microseconds>(
+      chrono::steady_clock::now() - start);
+    prompt->invalidate(latency_segment);
+    switch (result)
     {
       default:
         break;
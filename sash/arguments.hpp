@@ -0,0 +1,523 @@
+/******************************************************************************
+ *                   ____     ______   ____     __  __                        *
+ *                  /\  _`\  /\  _  \ /\  _`\  /\ \/\ \                       *
+ *                  \ \,\L\_\\ \ \L\ \\ \,\L\_\\ \ \_\ \                      *
+ *                   \/_\__ \ \ \  __ \\/_\__ \ \ \  _  \                     *
+ *                     /\ \L\ \\ \ \/\ \ /\ \L\ \\ \ \ \ \                    *
+ *                     \ `\____\\ \_\ \_\\ `\____\\ \_\ \_\                   *
+ *                      \/_____/ \/_/\/_/ \/_____/ \/_/\/_/                   *
+ *                                                                            *
+ *                                                                            *
+ * Copyright (c) 2014                                                         *
+ * Matthias Vallentin <vallentin (at) icir.org>                               *
+ * Dominik Charousset <dominik.charousset (at) haw-hamburg.de>                *
+ *                                                                            *
+ * Distributed under the 3-clause BSD License.                                *
+ * See accompanying file LICENSE.                                             *
+\******************************************************************************/
+
+#ifndef SASH_ARGUMENTS_HPP
+#define SASH_ARGUMENTS_HPP
+
+#include <cmath>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <cctype>
+#include <cstdint>
+#include <cstdlib>
+#include <utility>
+#include <algorithm>
+#include <initializer_list>
+
+#include "sash/cancellation.hpp"
+
+namespace sash {
+
+/// The type of a command argument.
+enum argument_type
+{
+  /// A single word.
+  word_arg,
+  /// A signed integer within a range.
+  integer_arg,
+  /// A floating point number.
+  real_arg,
+  /// One of `true`, `false`, `yes`, `no`, `on`, `off`, `1`, or `0`.
+  flag_arg,
+  /// A number followed by `ns`, `us`, `ms`, `s`, `m`, or `h`. Numbers
+  /// without unit denote seconds.
+  duration_arg,
+  /// One word out of a fixed set of choices.
+  choice_arg,
+  /// All remaining text of the line.
+  rest_arg
+};
+
+/// Describes a single argument of a command.
+struct argument_spec
+{
+  argument_spec(std::string arg_name, argument_type arg_type)
+    : name{std::move(arg_name)},
+      type{arg_type},
+      required{true},
+      min{INT64_MIN},
+      max{INT64_MAX}
+  {
+    // nop
+  }
+
+  /// Returns a copy of this argument that users can omit.
+  argument_spec optional() const
+  {
+    auto result = *this;
+    result.required = false;
+    return result;
+  }
+
+  std::string name;
+  argument_type type;
+  bool required;
+  int64_t min;
+  int64_t max;
+  std::vector<std::string> choices;
+};
+
+/// Factory functions for argument specifications.
+namespace arg {
+
+inline argument_spec word(std::string name)
+{
+  return {std::move(name), word_arg};
+}
+
+inline argument_spec integer(std::string name, int64_t min = INT64_MIN,
+                             int64_t max = INT64_MAX)
+{
+  argument_spec result{std::move(name), integer_arg};
+  result.min = min;
+  result.max = max;
+  return result;
+}
+
+inline argument_spec real(std::string name)
+{
+  return {std::move(name), real_arg};
+}
+
+inline argument_spec flag(std::string name)
+{
+  return {std::move(name), flag_arg};
+}
+
+inline argument_spec duration(std::string name)
+{
+  return {std::move(name), duration_arg};
+}
+
+inline argument_spec choice(std::string name,
+                            std::vector<std::string> choices)
+{
+  argument_spec result{std::move(name), choice_arg};
+  result.choices = std::move(choices);
+  return result;
+}
+
+inline argument_spec rest(std::string name)
+{
+  return {std::move(name), rest_arg};
+}
+
+} // namespace arg
+
+/// The parsed arguments of a command line. Values of words refer to the
+/// parsed line, i.e., a pack does not allocate and is only valid while the
+/// handler runs.
+class argument_pack
+{
+public:
+  /// An iterator to the command line input.
+  using iterator = std::string::const_iterator;
+
+  /// The maximum number of arguments per command.
+  static constexpr size_t max_size = 16;
+
+  argument_pack() : size_{0}, token_{nullptr}
+  {
+    // nop
+  }
+
+  /// Returns the number of given arguments, i.e., omitted optional
+  /// arguments at the end do not count.
+  size_t size() const
+  {
+    return size_;
+  }
+
+  /// Checks whether the argument at position @p i was given.
+  bool has(size_t i) const
+  {
+    return i < size_;
+  }
+
+  /// Returns the text of the argument at position @p i.
+  std::string str(size_t i) const
+  {
+    return std::string(values_[i].first, values_[i].last);
+  }
+
+  /// Returns the text of the argument at position @p i as range.
+  std::pair<iterator, iterator> text(size_t i) const
+  {
+    return {values_[i].first, values_[i].last};
+  }
+
+  int64_t integer(size_t i) const
+  {
+    return values_[i].integer;
+  }
+
+  double real(size_t i) const
+  {
+    return values_[i].real;
+  }
+
+  bool flag(size_t i) const
+  {
+    return values_[i].integer != 0;
+  }
+
+  std::chrono::nanoseconds duration(size_t i) const
+  {
+    return std::chrono::nanoseconds{values_[i].integer};
+  }
+
+  /// Returns the index of the selected choice.
+  size_t choice(size_t i) const
+  {
+    return static_cast<size_t>(values_[i].integer);
+  }
+
+  /// Returns the token for cancelling the command.
+  cancellation_token const& token() const
+  {
+    static cancellation_token none;
+    return token_ != nullptr ? *token_ : none;
+  }
+
+private:
+  friend class argument_schema;
+
+  struct value
+  {
+    iterator first;
+    iterator last;
+    int64_t integer;
+    double real;
+  };
+
+  value values_[max_size];
+  size_t size_;
+  cancellation_token const* token_;
+};
+
+/// The arguments of a command. Parses command lines into an
+/// {@link argument_pack} and reports errors in a uniform format.
+class argument_schema
+{
+public:
+  using iterator = std::string::const_iterator;
+
+  argument_schema()
+  {
+    // nop
+  }
+
+  /// @pre Required arguments precede optional ones and a `rest` argument
+  ///      comes last. Schemas with more than `argument_pack::max_size`
+  ///      arguments are invalid, see {@link valid}.
+  argument_schema(std::initializer_list<argument_spec> specs)
+    : specs_(specs)
+  {
+    // nop
+  }
+
+  /// Checks whether an {@link argument_pack} can hold all arguments, all
+  /// required arguments precede the optional ones and a `rest` argument,
+  /// if any, comes last.
+  bool valid() const
+  {
+    if (specs_.size() > argument_pack::max_size)
+      return false;
+    auto optional = false;
+    for (size_t i = 0; i < specs_.size(); ++i)
+    {
+      auto& s = specs_[i];
+      if ((s.required && optional)
+          || (s.type == rest_arg && i + 1 != specs_.size()))
+        return false;
+      optional = ! s.required;
+    }
+    return true;
+  }
+
+  std::vector<argument_spec> const& specs() const
+  {
+    return specs_;
+  }
+
+  /// Returns a usage string such as `connect <host> <port> [<timeout>]`.
+  std::string usage(std::string const& cmd) const
+  {
+    auto result = cmd;
+    for (auto& s : specs_)
+    {
+      result += s.required ? " <" : " [<";
+      result += s.name;
+      if (s.type == choice_arg)
+      {
+        result += ':';
+        for (size_t i = 0; i < s.choices.size(); ++i)
+          (result += i == 0 ? "" : "|") += s.choices[i];
+      }
+      result += s.type == rest_arg ? "...>" : ">";
+      if (! s.required)
+        result += ']';
+    }
+    return result;
+  }
+
+  /// Parses `[first, last)` into @p pack.
+  /// @param cmd The command name for error messages.
+  /// @param token The token for cancelling the command, if any.
+  /// @returns `false` on error, in which case @p err has the form
+  ///          `<cmd>: <problem>`.
+  bool parse(std::string& err, std::string const& cmd, iterator first,
+             iterator last, argument_pack& pack,
+             cancellation_token const* token = nullptr) const
+  {
+    pack.size_ = 0;
+    pack.token_ = token;
+    if (! valid())
+    {
+      if (specs_.size() > argument_pack::max_size)
+        err = cmd + ": too many arguments in schema (at most "
+              + std::to_string(argument_pack::max_size) + ")";
+      else
+        err = cmd + ": invalid schema (optional arguments must follow "
+                    "required ones and <rest> must come last)";
+      return false;
+    }
+    for (auto& s : specs_)
+    {
+      first = std::find_if(first, last, not_space);
+      if (first == last)
+      {
+        if (! s.required)
+          return true;
+        err = cmd + ": missing argument <" + s.name + ">; usage: "
+              + usage(cmd);
+        return false;
+      }
+      auto end = s.type == rest_arg ? last : std::find_if(first, last,
+                                                          is_space);
+      auto& v = pack.values_[pack.size_];
+      v.first = first;
+      v.last = end;
+      v.integer = 0;
+      v.real = 0;
+      std::string expected;
+      if (! convert(s, v, expected))
+      {
+        err = cmd + ": <" + s.name + ">: expected " + expected + ", got '"
+              + std::string(first, end) + "'";
+        return false;
+      }
+      ++pack.size_;
+      first = end;
+    }
+    if (std::find_if(first, last, not_space) != last)
+    {
+      err = cmd + ": too many arguments; usage: " + usage(cmd);
+      return false;
+    }
+    return true;
+  }
+
+  /// Returns completion candidates for the argument under the cursor,
+  /// where `[first, last)` is the text between command name and cursor.
+  std::vector<std::string> complete(iterator first, iterator last) const
+  {
+    size_t pos = 0;
+    for (;;)
+    {
+      first = std::find_if(first, last, not_space);
+      auto end = std::find_if(first, last, is_space);
+      if (end == last)
+        break;
+      first = end;
+      ++pos;
+    }
+    if (pos >= specs_.size())
+      return {};
+    auto& s = specs_[pos];
+    if (s.type == choice_arg)
+      return s.choices;
+    if (s.type == flag_arg)
+      return {"false", "true"};
+    return {};
+  }
+
+private:
+  static bool is_space(char c)
+  {
+    return isspace(static_cast<unsigned char>(c)) != 0;
+  }
+
+  static bool not_space(char c)
+  {
+    return ! is_space(c);
+  }
+
+  static bool equal(iterator first, iterator last, char const* str)
+  {
+    for (; first != last && *str != '\0'; ++first, ++str)
+      if (*first != *str)
+        return false;
+    return first == last && *str == '\0';
+  }
+
+  // Parses a decimal integer without allocating.
+  static bool to_integer(iterator first, iterator last, int64_t& x)
+  {
+    bool neg = first != last && *first == '-';
+    if (neg || (first != last && *first == '+'))
+      ++first;
+    if (first == last)
+      return false;
+    uint64_t limit = neg ? uint64_t{1} << 63 : INT64_MAX;
+    uint64_t result = 0;
+    for (; first != last; ++first)
+    {
+      if (*first < '0' || *first > '9')
+        return false;
+      auto digit = static_cast<uint64_t>(*first - '0');
+      if (result > (limit - digit) / 10)
+        return false;
+      result = result * 10 + digit;
+    }
+    x = neg ? static_cast<int64_t>(0 - result) : static_cast<int64_t>(result);
+    return true;
+  }
+
+  // Accepts finite decimal numbers only, i.e., neither `inf`, `nan` nor
+  // hexadecimal floats.
+  static bool to_real(iterator first, iterator last, double& x)
+  {
+    char buf[64];
+    auto n = static_cast<size_t>(last - first);
+    if (n == 0 || n >= sizeof(buf))
+      return false;
+    auto decimal = [](char c)
+    {
+      return (c >= '0' && c <= '9') || c == '.' || c == 'e' || c == 'E'
+             || c == '+' || c == '-';
+    };
+    if (! std::all_of(first, last, decimal))
+      return false;
+    std::copy(first, last, buf);
+    buf[n] = '\0';
+    char* end;
+    x = strtod(buf, &end);
+    return end == buf + n && std::isfinite(x);
+  }
+
+  // Converts the text of @p v or describes what was expected on error.
+  static bool convert(argument_spec const& s, argument_pack::value& v,
+                      std::string& expected)
+  {
+    switch (s.type)
+    {
+      default:
+        return true;
+      case integer_arg:
+        if (to_integer(v.first, v.last, v.integer)
+            && v.integer >= s.min && v.integer <= s.max)
+          return true;
+        expected = "an integer";
+        if (s.min != INT64_MIN || s.max != INT64_MAX)
+          expected += " between " + std::to_string(s.min) + " and "
+                      + std::to_string(s.max);
+        return false;
+      case real_arg:
+        if (to_real(v.first, v.last, v.real))
+          return true;
+        expected = "a number";
+        return false;
+      case flag_arg:
+        for (auto x : {"true", "yes", "on", "1"})
+          if (equal(v.first, v.last, x))
+          {
+            v.integer = 1;
+            return true;
+          }
+        for (auto x : {"false", "no", "off", "0"})
+          if (equal(v.first, v.last, x))
+            return true;
+        expected = "true or false";
+        return false;
+      case duration_arg:
+        if (to_duration(v))
+          return true;
+        expected = "a duration such as 10s or 250ms";
+        return false;
+      case choice_arg:
+        for (size_t i = 0; i < s.choices.size(); ++i)
+          if (equal(v.first, v.last, s.choices[i].c_str()))
+          {
+            v.integer = static_cast<int64_t>(i);
+            return true;
+          }
+        expected = "one of";
+        for (size_t i = 0; i < s.choices.size(); ++i)
+          (expected += i == 0 ? " " : ", ") += s.choices[i];
+        return false;
+    }
+  }
+
+  static bool to_duration(argument_pack::value& v)
+  {
+    auto unit = std::find_if(v.first, v.last, [](char c)
+    {
+      return isalpha(static_cast<unsigned char>(c)) != 0;
+    });
+    double count;
+    if (! to_real(v.first, unit, count) || count < 0)
+      return false;
+    double factor;
+    if (unit == v.last || equal(unit, v.last, "s"))
+      factor = 1e9;
+    else if (equal(unit, v.last, "ns"))
+      factor = 1;
+    else if (equal(unit, v.last, "us"))
+      factor = 1e3;
+    else if (equal(unit, v.last, "ms"))
+      factor = 1e6;
+    else if (equal(unit, v.last, "m"))
+      factor = 60e9;
+    else if (equal(unit, v.last, "h"))
+      factor = 3600e9;
+    else
+      return false;
+    if (count * factor >= 9.2e18)
+      return false;
+    v.integer = static_cast<int64_t>(count * factor);
+    return true;
+  }
+
+  std::vector<argument_spec> specs_;
+};
+
+} // namespace sash
+
+#endif // SASH_ARGUMENTS_HPP
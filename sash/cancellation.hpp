@@ -0,0 +1,165 @@
+/******************************************************************************
+ *                   ____     ______   ____     __  __                        *
+ *                  /\  _`\  /\  _  \ /\  _`\  /\ \/\ \                       *
+ *                  \ \,\L\_\\ \ \L\ \\ \,\L\_\\ \ \_\ \                      *
+ *                   \/_\__ \ \ \  __ \\/_\__ \ \ \  _  \                     *
+ *                     /\ \L\ \\ \ \/\ \ /\ \L\ \\ \ \ \ \                    *
+ *                     \ `\____\\ \_\ \_\\ `\____\\ \_\ \_\                   *
+ *                      \/_____/ \/_/\/_/ \/_____/ \/_/\/_/                   *
+ *                                                                            *
+ *                                                                            *
+ * Copyright (c) 2014                                                         *
+ * Matthias Vallentin <vallentin (at) icir.org>                               *
+ * Dominik Charousset <dominik.charousset (at) haw-hamburg.de>                *
+ *                                                                            *
+ * Distributed under the 3-clause BSD License.                                *
+ * See accompanying file LICENSE.                                             *
+\******************************************************************************/
+
+#ifndef SASH_CANCELLATION_HPP
+#define SASH_CANCELLATION_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+#include <time.h>
+#include <signal.h>
+
+namespace sash {
+
+/// Owns the state of a cancellation request. Requesting cancellation is
+/// async-signal-safe, i.e., a source can be cancelled from a signal handler.
+class cancellation_source
+{
+  cancellation_source(cancellation_source const&) = delete;
+  cancellation_source& operator=(cancellation_source const&) = delete;
+
+public:
+  cancellation_source() : flag_{false}, requested_at_{0}
+  {
+    // nop
+  }
+
+  /// Requests cancellation.
+  void cancel()
+  {
+    if (flag_)
+      return;
+    requested_at_ = now();
+    flag_ = true;
+  }
+
+  /// Clears a previous cancellation request.
+  void reset()
+  {
+    flag_ = false;
+    requested_at_ = 0;
+  }
+
+  /// Checks whether cancellation was requested.
+  bool cancelled() const
+  {
+    return flag_.load(std::memory_order_relaxed);
+  }
+
+  /// Returns the time since cancellation was requested.
+  std::chrono::nanoseconds elapsed() const
+  {
+    return std::chrono::nanoseconds{cancelled() ? now() - requested_at_ : 0};
+  }
+
+private:
+  // Uses clock_gettime, because it is async-signal-safe.
+  static int64_t now()
+  {
+    timespec ts;
+    ::clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+  }
+
+  std::atomic<bool> flag_;
+  std::atomic<int64_t> requested_at_;
+};
+
+/// A cheap, copyable view to a cancellation source that long-running command
+/// handlers poll to find out whether they should abort. A default-constructed
+/// token is never cancelled.
+class cancellation_token
+{
+public:
+  explicit cancellation_token(cancellation_source const* src = nullptr)
+    : src_{src}
+  {
+    // nop
+  }
+
+  /// Checks whether cancellation was requested.
+  bool cancelled() const
+  {
+    return src_ != nullptr && src_->cancelled();
+  }
+
+  explicit operator bool() const
+  {
+    return cancelled();
+  }
+
+private:
+  cancellation_source const* src_;
+};
+
+/// Cancels a source on SIGINT while in scope and restores the previous
+/// signal disposition afterwards. A second SIGINT while cancellation is
+/// still pending terminates the process, which keeps handlers that never
+/// poll their token interruptible.
+class interrupt_guard
+{
+  interrupt_guard(interrupt_guard const&) = delete;
+  interrupt_guard& operator=(interrupt_guard const&) = delete;
+
+public:
+  explicit interrupt_guard(cancellation_source& src)
+    : prev_src_{active().exchange(&src)}
+  {
+    if (prev_src_ != &src)
+      src.reset();
+    struct sigaction sa;
+    sa.sa_handler = handler;
+    sa.sa_flags = 0; // no SA_RESTART, blocking calls should see EINTR
+    sigemptyset(&sa.sa_mask);
+    ::sigaction(SIGINT, &sa, &prev_action_);
+  }
+
+  ~interrupt_guard()
+  {
+    ::sigaction(SIGINT, &prev_action_, nullptr);
+    active() = prev_src_;
+  }
+
+private:
+  static std::atomic<cancellation_source*>& active()
+  {
+    static std::atomic<cancellation_source*> instance{nullptr};
+    return instance;
+  }
+
+  static void handler(int)
+  {
+    auto src = active().load();
+    if (src == nullptr || src->cancelled())
+    {
+      ::signal(SIGINT, SIG_DFL);
+      ::raise(SIGINT);
+      return;
+    }
+    src->cancel();
+  }
+
+  cancellation_source* prev_src_;
+  struct sigaction prev_action_;
+};
+
+} // namespace sash
+
+#endif // SASH_CANCELLATION_HPP
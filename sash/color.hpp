@@ -36,6 +36,7 @@ constexpr char blue[]         = "\033[34m";
 constexpr char magenta[]      = "\033[35m";
 constexpr char cyan[]         = "\033[36m";
 constexpr char white[]        = "\033[37m";
+constexpr char grey[]         = "\033[90m";
 constexpr char bold_black[]   = "\033[1m\033[30m";
 constexpr char bold_red[]     = "\033[1m\033[31m";
 constexpr char bold_green[]   = "\033[1m\033[32m";
@@ -19,15 +19,26 @@
 #ifndef SASH_COMMAND_HPP
 #define SASH_COMMAND_HPP
 
+#include <atomic>
+#include <chrono>
 #include <memory>
 #include <string>
-#include <sstream>
+#include <vector>
 #include <cassert>
 #include <numeric>
-#include <iomanip>
+#include <iterator>
 #include <algorithm>
+#include <functional>
 
+#include "sash/io.hpp"
+#include "sash/stats.hpp"
+#include "sash/style.hpp"
+#include "sash/tracing.hpp"
+#include "sash/arguments.hpp"
 #include "sash/completer.hpp"
+#include "sash/memo_cache.hpp"
+#include "sash/cancellation.hpp"
+#include "sash/command_index.hpp"
 
 namespace sash {
 
@@ -48,9 +59,11 @@ enum command_result
 /// callback is invoked whenever a command is executed. The first iterator
 /// points to the first input character, the second iterator to the end
 /// of the string.
-template<class Completer, class CommandCallback>
-class command : public std::enable_shared_from_this<command<Completer,
-                                                            CommandCallback>>
+/// @tparam Tracer A tracing policy, see {@link null_tracer}.
+template<class Completer, class CommandCallback, class Tracer = null_tracer>
+class command
+  : public std::enable_shared_from_this<command<Completer, CommandCallback,
+                                                Tracer>>
 {
   command(command const&) = delete; // you shall not pass
   command& operator=(command const&) = delete; // you neither
@@ -67,6 +80,25 @@ public:
 
   using callback_type = CommandCallback;
 
+  /// A callback receiving arguments parsed according to an
+  /// {@link argument_schema}.
+  using typed_callback_type =
+    std::function<command_result (std::string&, argument_pack const&)>;
+
+  /// A callback for completing arguments. It receives the text between the
+  /// name of the command and the cursor and returns candidates for the
+  /// last word of it, which can be empty. Candidates not starting with
+  /// this word are ignored.
+  using argument_completer_type =
+    std::function<std::vector<std::string> (const_iterator, const_iterator)>;
+
+  /// A callback that receives a cancellation token in addition to the
+  /// arguments of `CommandCallback`. Long-running handlers should poll the
+  /// token and return early once cancellation was requested.
+  using cancellable_callback_type =
+    std::function<command_result (std::string&, const_iterator,
+                                  const_iterator, cancellation_token const&)>;
+
   /// Constructs a command.
   /// @param comp The completion context this command exists in.
   /// @param name The name of the command.
@@ -78,23 +110,11 @@ public:
           std::string desc)
       : parent_{std::move(parent)},
         completer_{std::move(comp)},
+        version_{0},
         name_{std::move(name)},
         description_{std::move(desc)}
   {
-    if (! is_root())
-    {
-      completer_->add_completion(absolute_name() + ' ');
-    }
-    // else: I am ROOT
-    //       The only one
-    //       I will bring back
-    //       Freedom to your heart
-    //       You won't believe
-    //       That blind can't see
-    //       No one else before me ever knew
-    //       The way to paradise
-    //       For another bloody crime
-    //       I shall return
+    // nop
   }
 
   /// Adds a sub-command to this command.
@@ -103,9 +123,8 @@ public:
   /// @returns If successful, a valid pointer to the newly created command.
   pointer add(std::string name, std::string desc)
   {
-    if (name.empty() || std::any_of(children_.begin(), children_.end(),
-                                    [&](pointer const& child)
-                                    { return child->name() == name; }))
+    if (! is_valid_key(name)
+        || index_.find(name.data(), name.size(), false) != nullptr)
     {
       return nullptr;
     }
@@ -113,21 +132,182 @@ public:
                                                   completer_,
                                                   std::move(name),
                                                   std::move(desc)));
+    index_.add(children_.back()->name(), children_.back());
+    version_.fetch_add(1, std::memory_order_release);
+    if (stats_registry_)
+      children_.back()->enable_stats(stats_registry_);
     return children_.back();
   }
 
+  /// Adds a sub-command with typed arguments to this command.
+  /// @param name The name of the command.
+  /// @param desc A one-line description of the command.
+  /// @param schema The arguments of the new command.
+  /// @param f The function to execute for the parsed arguments.
+  /// @returns If successful, a valid pointer to the newly created command,
+  ///          or `nullptr` if @p schema is not {@link argument_schema::valid}.
+  pointer add(std::string name, std::string desc, argument_schema schema,
+              typed_callback_type f)
+  {
+    if (! schema.valid())
+      return nullptr;
+    auto ptr = add(std::move(name), std::move(desc));
+    if (ptr)
+      ptr->on(std::move(schema), std::move(f));
+    return ptr;
+  }
+
   pointer add_copy(pointer cmd) {
     auto cpy = add(cmd->name(), cmd->description());
     if (cpy)
-      cpy->on(cmd->handler_);
+    {
+      cpy->handler_ = cmd->handler_;
+      cpy->cancellable_handler_ = cmd->cancellable_handler_;
+      cpy->argument_completer_ = cmd->argument_completer_;
+    }
     return cpy;
   }
 
+  /// Adds an alternative name for this command.
+  /// @returns `false` if this is the root command or if a sibling already
+  ///          uses @p alias as name or alias.
+  bool add_alias(std::string alias)
+  {
+    if (is_root() || ! is_valid_key(alias))
+      return false;
+    if (! parent_->index_.add(std::move(alias), this->shared_from_this()))
+      return false;
+    parent_->version_.fetch_add(1, std::memory_order_release);
+    return true;
+  }
+
   /// Assigns a callback handler for arguments to this command.
   /// @param f The function to execute for the command arguments.
   void on(CommandCallback f)
   {
     handler_ = std::move(f);
+    cancellable_handler_ = nullptr;
+  }
+
+  /// Assigns a cancellable callback handler for arguments to this command.
+  /// @param f The function to execute for the command arguments.
+  void on_cancellable(cancellable_callback_type f)
+  {
+    cancellable_handler_ = std::move(f);
+    handler_ = CommandCallback{};
+  }
+
+  /// Assigns a callback handler for arguments that are parsed and validated
+  /// according to @p schema before invoking @p f. On invalid arguments,
+  /// the command fails with an error such as `<name>: <port>: expected an
+  /// integer, got 'x'`. Unless this command has an argument completer,
+  /// the choices of arguments become completion candidates.
+  /// @returns `false` if @p schema is not {@link argument_schema::valid},
+  ///          in which case the handler remains unchanged.
+  bool on(argument_schema schema, typed_callback_type f)
+  {
+    if (! schema.valid())
+      return false;
+    auto name = name_;
+    auto parse = [schema, f, name](std::string& err, const_iterator first,
+                                   const_iterator last,
+                                   cancellation_token const& token)
+    {
+      argument_pack pack;
+      if (! schema.parse(err, name, first, last, pack, &token))
+        return no_command;
+      return f(err, pack);
+    };
+    on_cancellable(parse);
+    if (! argument_completer_)
+      argument_completer_ = [schema](const_iterator first,
+                                     const_iterator last)
+      {
+        return schema.complete(first, last);
+      };
+    return true;
+  }
+
+  /// Assigns a callback for completing the arguments of this command.
+  /// @param f The function returning candidates for the current argument.
+  void on_complete_args(argument_completer_type f)
+  {
+    argument_completer_ = std::move(f);
+  }
+
+  /// Collects candidates for the word under the cursor, where `[first,
+  /// last)` is the text between the name of this command and the cursor.
+  /// Complete words that resolve to a sub-command select that sub-command,
+  /// otherwise the candidates are the matching sub-commands followed by
+  /// the matching results of the argument completer.
+  /// @param words Receives the candidate words.
+  void complete(const_iterator first, const_iterator last,
+                std::vector<std::string>& words) const
+  {
+    first = std::find_if(first, last, [](char c) { return c != ' '; });
+    auto delim = std::find(first, last, ' ');
+    auto dist = static_cast<size_t>(std::distance(first, delim));
+    if (delim != last && first != delim)
+    {
+      auto cmd = index_.find(&*first, dist, ! has_handler());
+      if (cmd != nullptr)
+        return (*cmd)->complete(delim + 1, last, words);
+    }
+    else
+    {
+      for (auto& cmd : children_)
+      {
+        auto& n = cmd->name();
+        if (dist <= n.size() && std::equal(first, delim, n.begin()))
+          words.push_back(n);
+      }
+    }
+    if (! argument_completer_)
+      return;
+    auto word = std::find(std::reverse_iterator<const_iterator>(last),
+                          std::reverse_iterator<const_iterator>(first),
+                          ' ').base();
+    auto len = static_cast<size_t>(std::distance(word, last));
+    for (auto& str : argument_completer_(first, last))
+      if (len <= str.size() && std::equal(word, last, str.begin()))
+        words.push_back(std::move(str));
+  }
+
+  /// Records calls to the handlers of this command and of all current and
+  /// future sub-commands in @p reg, using the absolute name as path or the
+  /// name for the root command. Passing `nullptr` disables recording.
+  void enable_stats(std::shared_ptr<stats_registry> reg)
+  {
+    if (reg)
+      stats_ = reg->get(is_root() ? name_ : absolute_name());
+    else
+      stats_ = nullptr;
+    for (auto& child : children_)
+      child->enable_stats(reg);
+    stats_registry_ = std::move(reg);
+  }
+
+  /// Marks this command as pure read, i.e., replays the output of a
+  /// previous call with the same arguments instead of invoking the handler.
+  /// Arguments are compared with whitespace normalized outside of quotes.
+  /// Only successful calls without piped {@link input} are cached. While
+  /// computing a result, the output of the handler is buffered, i.e., it
+  /// appears when the handler returns.
+  /// @param ttl The time after which cached results expire, or zero to
+  ///            keep them until @p tag is bumped.
+  /// @param tag A tag for invalidating the cached results.
+  /// @param max_entries The maximum number of cached argument strings.
+  void cache_results(std::chrono::steady_clock::duration ttl,
+                     cache_tag tag = cache_tag{}, size_t max_entries = 64)
+  {
+    memo_ = std::make_shared<memo_cache>(ttl, std::move(tag), max_entries);
+  }
+
+  /// Drops all cached results of this command.
+  void clear_cached_results()
+  {
+    if (memo_)
+      memo_->clear();
   }
 
   /// Retrieves the name of this very command.
@@ -163,42 +343,96 @@ public:
   /// @returns The help string for this command.
   std::string help(size_t indent = 0) const
   {
-    if (children_.empty())
-      return "";
+    return help_table(children_, indent);
+  }
+
+  /// Formats one line per command in @p cmds with aligned descriptions.
+  /// Command names are bold if the {@link output} is a color terminal.
+  /// @param cmds A container of command pointers.
+  /// @param indent The number of spaces to indent each line.
+  template<class Container>
+  static std::string help_table(Container const& cmds, size_t indent)
+  {
+    using name_style = style::sgr<style::bold>;
     auto binary_op = [](size_t old_max, pointer const& cmd)
     {
       return std::max(old_max, cmd->name().size());
     };
-    size_t max_len = std::accumulate(children_.begin(), children_.end(),
-                                     size_t{0}, binary_op);
-    std::string padding(indent, ' ');
-    std::ostringstream oss;
-    oss << std::left;
-    for (auto& cmd : children_)
-      // always separate name & desciption by at least two spaces
-      oss << padding << std::setw(static_cast<int>(max_len)) << cmd->name()
-          << "  " << cmd->description() << "\n";
-    return oss.str();
+    size_t max_len = std::accumulate(cmds.begin(), cmds.end(), size_t{0},
+                                     binary_op);
+    auto colors = output_colors();
+    // always separate name & desciption by at least two spaces
+    auto size = std::accumulate(cmds.begin(), cmds.end(), size_t{0},
+                                [&](size_t n, pointer const& cmd)
+                                {
+                                  return n + cmd->description().size();
+                                });
+    size += cmds.size() * (indent + max_len + 3);
+    if (colors)
+      size += cmds.size() * (name_style::size + style::reset::size);
+    std::string result(size, ' ');
+    styled_buffer buf{&result[0], size, colors};
+    for (auto& cmd : cmds)
+    {
+      buf.fill(' ', indent);
+      buf.styled<name_style>(cmd->name());
+      buf.fill(' ', max_len - cmd->name().size() + 2);
+      buf.append(cmd->description());
+      buf.append("\n", 1);
+    }
+    return result;
   }
 
   /// Execute a command line.
   command_result execute(std::string& err,
                          const_iterator first,
                          const_iterator last) const
+  {
+    return execute(err, first, last, cancellation_token{});
+  }
+
+  /// Execute a command line that can be cancelled via @p token. Each word
+  /// selects a sub-command by name, by alias, or, if this command has no
+  /// handler for arguments, by a prefix that is unique among all names and
+  /// aliases of the sub-commands.
+  command_result execute(std::string& err,
+                         const_iterator first,
+                         const_iterator last,
+                         cancellation_token const& token) const
   {
     if (is_root() && first == last)
       return nop;
     auto delim = std::find(first, last, ' ');
-    for (auto& cmd : children_)
+    if (first != delim && index_.size() > 0)
+    {
+      auto len = static_cast<size_t>(delim - first);
+      auto cmd = index_.find_exact(&*first, len);
+      if (cmd == nullptr && ! has_handler())
+      {
+        std::vector<std::string> candidates;
+        cmd = index_.find_prefix(&*first, len, &candidates);
+        if (! candidates.empty())
+        {
+          ambiguous(err, first, delim, candidates);
+          return no_command;
+        }
+      }
+      if (cmd != nullptr)
+        return (*cmd)->execute(err, delim == last ? last : delim + 1, last,
+                               token);
+    }
+    if (cancellable_handler_ || handler_)
     {
-      auto dist = static_cast<size_t>(std::distance(first, delim));
-      auto& n = cmd->name();
-      if (dist == n.size() && std::equal(first, delim, n.begin()))
-        return cmd->execute(err, delim == last ? std::string{}
-                                               : std::string(delim + 1, last));
+      typename Tracer::span span{"handler", name_};
+      if (! stats_)
+        return invoke(err, first, last, token);
+      auto t0 = std::chrono::steady_clock::now();
+      auto result = invoke(err, first, last, token);
+      auto t1 = std::chrono::steady_clock::now();
+      stats_->record(result, static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count()));
+      return result;
     }
-    if (handler_)
-      return handler_(err, first, last);
     err.clear();
     err.insert(err.end(), first, delim);
     err += ": command not found";
@@ -211,6 +445,13 @@ public:
     return execute(err, line.begin(), line.end());
   }
 
+  /// Execute a command line that can be cancelled via @p token.
+  command_result execute(std::string& err, std::string const& line,
+                         cancellation_token const& token) const
+  {
+    return execute(err, line.begin(), line.end(), token);
+  }
+
   bool is_root() const
   {
     return parent_ == nullptr;
@@ -226,17 +467,102 @@ public:
     return description_;
   }
 
+  /// Checks whether a handler for arguments is assigned to this command.
+  bool has_handler() const
+  {
+    return cancellable_handler_ || handler_;
+  }
+
   const std::vector<pointer>& children() const {
     return children_;
   }
 
+  /// Returns the names and aliases of all sub-commands.
+  command_index<pointer> const& index() const
+  {
+    return index_;
+  }
+
+  /// Returns a counter that increases whenever a sub-command or an alias
+  /// of a sub-command is added. Safe to call from any thread.
+  uint64_t version() const
+  {
+    return version_.load(std::memory_order_acquire);
+  }
+
+  /// Reports an ambiguous abbreviation `[first, last)` in @p err.
+  static void ambiguous(std::string& err, const_iterator first,
+                        const_iterator last,
+                        std::vector<std::string> const& candidates)
+  {
+    err.assign(first, last);
+    err += ": ambiguous command; candidates:";
+    for (auto& str : candidates)
+      (err += ' ') += str;
+  }
+
 private:
+  static bool is_valid_key(std::string const& str)
+  {
+    return ! str.empty() && str.find(' ') == std::string::npos;
+  }
+
+  command_result invoke(std::string& err, const_iterator first,
+                        const_iterator last,
+                        cancellation_token const& token) const
+  {
+    // Piped input is not part of the key, i.e., results of pipeline stages
+    // other than the first are never cached.
+    if (memo_ && input() == nullptr)
+      return invoke_cached(err, first, last, token);
+    if (cancellable_handler_)
+      return cancellable_handler_(err, first, last, token);
+    return handler_(err, first, last);
+  }
+
+  command_result invoke_cached(std::string& err, const_iterator first,
+                               const_iterator last,
+                               cancellation_token const& token) const
+  {
+    std::string key;
+    memo_cache::normalize(first, last, key);
+    std::string out;
+    if (memo_->lookup(key, out))
+    {
+      output() << out;
+      if (stats_)
+        stats_->record_cache_hit();
+      return executed;
+    }
+    auto version = memo_->tag().version();
+    command_result result;
+    {
+      string_writer buf{out};
+      std::ostream os{&buf};
+      io_redirect guard{&os, input()};
+      result = cancellable_handler_ ? cancellable_handler_(err, first, last,
+                                                           token)
+                                    : handler_(err, first, last);
+    }
+    output() << out;
+    if (result == executed && ! token.cancelled())
+      memo_->store(std::move(key), std::move(out), version);
+    return result;
+  }
+
   pointer parent_;
   completer_pointer completer_;
   std::vector<pointer> children_;
+  command_index<pointer> index_;
+  std::atomic<uint64_t> version_;
   std::string name_;
   std::string description_;
   CommandCallback handler_;
+  cancellable_callback_type cancellable_handler_;
+  argument_completer_type argument_completer_;
+  std::shared_ptr<memo_cache> memo_;
+  std::shared_ptr<stats_registry> stats_registry_;
+  std::shared_ptr<command_stats> stats_;
 };
 
 } // namespace sash
@@ -0,0 +1,161 @@
+/******************************************************************************
+ *                   ____     ______   ____     __  __                        *
+ *                  /\  _`\  /\  _  \ /\  _`\  /\ \/\ \                       *
+ *                  \ \,\L\_\\ \ \L\ \\ \,\L\_\\ \ \_\ \                      *
+ *                   \/_\__ \ \ \  __ \\/_\__ \ \ \  _  \                     *
+ *                     /\ \L\ \\ \ \/\ \ /\ \L\ \\ \ \ \ \                    *
+ *                     \ `\____\\ \_\ \_\\ `\____\\ \_\ \_\                   *
+ *                      \/_____/ \/_/\/_/ \/_____/ \/_/\/_/                   *
+ *                                                                            *
+ *                                                                            *
+ * Copyright (c) 2014                                                         *
+ * Matthias Vallentin <vallentin (at) icir.org>                               *
+ * Dominik Charousset <dominik.charousset (at) haw-hamburg.de>                *
+ *                                                                            *
+ * Distributed under the 3-clause BSD License.                                *
+ * See accompanying file LICENSE.                                             *
+\******************************************************************************/
+
+#ifndef SASH_COMMAND_INDEX_HPP
+#define SASH_COMMAND_INDEX_HPP
+
+#include <string>
+#include <vector>
+#include <cstring>
+#include <algorithm>
+
+namespace sash {
+
+/// Maps names and aliases of sibling commands to the commands, sorted by
+/// key. Resolving a word takes O(log n) for exact matches as well as for
+/// checking whether an abbreviation is unique. Lookups return pointers
+/// into the index to avoid touching reference counts while dispatching.
+/// @tparam Pointer A (smart) pointer to a command with a `name()` member.
+template <class Pointer>
+class command_index
+{
+public:
+  struct entry
+  {
+    std::string key;
+    Pointer cmd;
+  };
+
+  /// Adds @p key for @p cmd.
+  /// @returns `false` if @p key already exists.
+  bool add(std::string key, Pointer cmd)
+  {
+    auto i = lower_bound(key.data(), key.size());
+    if (i != entries_.end() && i->key == key)
+      return false;
+    entries_.insert(i, entry{std::move(key), std::move(cmd)});
+    return true;
+  }
+
+  std::vector<entry> const& entries() const
+  {
+    return entries_;
+  }
+
+  size_t size() const
+  {
+    return entries_.size();
+  }
+
+  /// Resolves the word `[str, str + len)` to a command with this key or,
+  /// if @p abbreviate is `true`, to the only command having a key starting
+  /// with the word.
+  /// @param candidates Receives the names of all matching commands if the
+  ///                   abbreviation is ambiguous.
+  /// @returns A pointer to the matching command or `nullptr`.
+  Pointer const* find(char const* str, size_t len, bool abbreviate,
+                     std::vector<std::string>* candidates = nullptr) const
+  {
+    auto cmd = find_exact(str, len);
+    if (cmd != nullptr || ! abbreviate)
+      return cmd;
+    return find_prefix(str, len, candidates);
+  }
+
+  /// Resolves the word `[str, str + len)` to the command with this key.
+  /// @returns A pointer to the matching command or `nullptr`.
+  Pointer const* find_exact(char const* str, size_t len) const
+  {
+    // Scanning few keys beats a binary search.
+    if (entries_.size() <= 8)
+    {
+      for (auto& e : entries_)
+        if (e.key.size() == len && std::equal(str, str + len, e.key.data()))
+          return &e.cmd;
+      return nullptr;
+    }
+    auto i = lower_bound(str, len);
+    if (i != entries_.end() && i->key.size() == len
+        && std::memcmp(i->key.data(), str, len) == 0)
+      return &i->cmd;
+    return nullptr;
+  }
+
+  /// Resolves the word `[str, str + len)` to the only command having a
+  /// key starting with the word.
+  /// @param candidates Receives the names of all matching commands if the
+  ///                   abbreviation is ambiguous.
+  /// @returns A pointer to the matching command or `nullptr`.
+  Pointer const* find_prefix(char const* str, size_t len,
+                             std::vector<std::string>* candidates
+                               = nullptr) const
+  {
+    auto first = lower_bound(str, len);
+    if (first == entries_.end() || ! starts_with(first->key, str, len))
+      return nullptr;
+    // All keys starting with the word follow the first one.
+    auto last = std::partition_point(first, entries_.end(),
+                                     [&](entry const& e)
+                                     {
+                                       return starts_with(e.key, str, len);
+                                     });
+    auto same = [&](entry const& e) { return e.cmd == first->cmd; };
+    if (std::all_of(first, last, same))
+      return &first->cmd;
+    if (candidates != nullptr)
+    {
+      for (auto i = first; i != last; ++i)
+        if (std::find(candidates->begin(), candidates->end(),
+                      i->cmd->name()) == candidates->end())
+          candidates->push_back(i->cmd->name());
+      std::sort(candidates->begin(), candidates->end());
+    }
+    return nullptr;
+  }
+
+private:
+  static bool starts_with(std::string const& key, char const* str,
+                          size_t len)
+  {
+    return key.size() >= len && std::memcmp(key.data(), str, len) == 0;
+  }
+
+  // Compares like `std::string::compare` without bounds checks.
+  static bool less(std::string const& key, char const* str, size_t len)
+  {
+    auto n = std::min(key.size(), len);
+    auto res = std::memcmp(key.data(), str, n);
+    return res < 0 || (res == 0 && key.size() < len);
+  }
+
+  typename std::vector<entry>::const_iterator
+  lower_bound(char const* str, size_t len) const
+  {
+    return std::lower_bound(entries_.begin(), entries_.end(), 0,
+                            [&](entry const& e, int)
+                            {
+                              return less(e.key, str, len);
+                            });
+  }
+
+  std::vector<entry> entries_;
+};
+
+} // namespace sash
+
+#endif // SASH_COMMAND_INDEX_HPP
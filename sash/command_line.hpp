@@ -20,13 +20,27 @@
 #define SASH_COMMAND_LINE_HPP
 
 #include <map>
+#include <mutex>
+#include <atomic>
+#include <chrono>
 #include <memory>
 #include <vector>
+#include <cstdint>
 #include <cctype>
+#include <cstdlib>
+#include <iostream>
 
 #include "sash/mode.hpp"
 #include "sash/color.hpp"
+#include "sash/stats.hpp"
+#include "sash/tracing.hpp"
 #include "sash/command.hpp"
+#include "sash/pipeline.hpp"
+#include "sash/line_parser.hpp"
+#include "sash/output_queue.hpp"
+#include "sash/preprocessor_chain.hpp"
+#include "sash/job_control.hpp"
+#include "sash/cancellation.hpp"
 
 namespace sash {
 
@@ -37,8 +51,18 @@ namespace sash {
 /// history. A command is a recursive element consisting of zero or more
 /// space-separated sub-commands. Each command has a description and a callback
 /// handler for arguments which themselves are not commands.
+///
+/// Modes and preprocessors live in a read-mostly registry: adding or removing
+/// them publishes a new snapshot, while processing only re-reads the
+/// snapshot after a change. Hence, multiple threads can safely call
+/// `process` concurrently as long as each uses its own
+/// {@link execution_context} and the command trees no longer change.
 /// @tparam Backend The CLI implementation, e.g., libedit.
-template<class Backend, class Command, class Preprocessor>
+/// @tparam Tracer A tracing policy recording spans for processing,
+///                preprocessing, dispatching and history, see
+///                {@link null_tracer} and {@link recording_tracer}.
+template<class Backend, class Command, class Preprocessor,
+         class Tracer = null_tracer>
 class command_line
 {
 public:
@@ -51,10 +75,77 @@ public:
   /// A unique pointer to our backend.
   using backend_ptr = std::unique_ptr<Backend>;
 
-  using mode_type = mode<Backend, Command>;
+  using mode_type = mode<Backend, Command, Tracer>;
 
   using mode_ptr = std::shared_ptr<mode_type>;
 
+private:
+  struct registry
+  {
+    std::map<std::string, mode_ptr> modes;
+    std::vector<Preprocessor> preprocessors;
+    std::shared_ptr<stats_registry> stats;
+    std::shared_ptr<command_stats> process_stats;
+  };
+
+  using registry_ptr = std::shared_ptr<const registry>;
+
+  // The buffers for processing a line, kept between calls.
+  struct line_buffers
+  {
+    // Splits the line into segments.
+    line_parser parser;
+    // Splits a preprocessed segment into stages.
+    line_parser stage_parser;
+    // Ping-pong buffers for the preprocessors.
+    std::string in;
+    std::string out;
+    // The errors of a single segment and of a single stage.
+    std::string err;
+    std::string stage_err;
+  };
+
+public:
+  /// The state of a single call to {@link process}. Threads processing
+  /// commands concurrently each need their own context. A context keeps
+  /// its buffers between calls, i.e., processing does not allocate once
+  /// the buffers have grown to fit the longest line.
+  class execution_context
+  {
+  public:
+    explicit execution_context(mode_ptr m = nullptr)
+      : mode{std::move(m)},
+        version_{0}
+    {
+      // nop
+    }
+
+    /// The mode for executing commands.
+    mode_ptr mode;
+
+    /// Receives the error message of failed commands.
+    std::string error;
+
+    /// Allows handlers to abort long-running commands.
+    cancellation_token token;
+
+  private:
+    friend class command_line;
+    line_buffers buf_;
+    registry_ptr registry_;
+    uint64_t version_;
+  };
+
+  command_line()
+    : registry_{std::make_shared<registry>()},
+      version_{1},
+      depth_{0},
+      interruptible_{true},
+      last_cancel_latency_{0}
+  {
+    // nop
+  }
+
   /// Creates a new mode for a set of related commands. Only one mode can
   /// be active at a time. Each mode has its own history.
   /// @param name The name of the mode.
@@ -67,24 +158,69 @@ public:
                     char const* prompt_color = nullptr,
                     std::string history_file = std::string{})
   {
-    auto& ptrref = modes_[name];
-    if (ptrref == nullptr)
+    mode_ptr result;
+    update([&](registry& reg)
     {
+      auto& ptrref = reg.modes[name];
+      if (ptrref != nullptr)
+        return false; // return nullptr to indicate that we didn't insert
       ptrref = std::make_shared<mode_type>(std::move(name),
                                            std::move(history_file),
                                            1000,
                                            true,
                                            std::move(prompt),
                                            prompt_color);
-      return ptrref;
-    }
-    // return nullptr to indicate that we didn't insert a new element
-    return nullptr;
+      if (reg.stats)
+        ptrref->root_command()->enable_stats(reg.stats);
+      result = ptrref;
+      return true;
+    });
+    return result;
   }
 
-  /// Processes a single command from the command line.
+  /// Adds an existing mode, e.g., to share the commands and completions of
+  /// a mode between multiple command lines.
+  /// @param ptr The mode to add.
+  /// @returns `true` on success, `false` if a mode with the same name exists.
+  bool mode_add(mode_ptr ptr)
+  {
+    return update([&](registry& reg)
+    {
+      auto& ptrref = reg.modes[ptr->name()];
+      if (ptrref != nullptr)
+        return false;
+      if (reg.stats)
+        ptr->root_command()->enable_stats(reg.stats);
+      ptrref = std::move(ptr);
+      return true;
+    });
+  }
+
+  /// Creates a context for calling {@link process} concurrently.
+  /// @param name The name of the mode for executing commands.
+  /// @returns A context without mode if no mode named @p name exists.
+  execution_context make_context(std::string const& name) const
+  {
+    auto reg = snapshot();
+    auto i = reg->modes.find(name);
+    return execution_context{i != reg->modes.end() ? i->second : nullptr};
+  }
+
+  /// Processes a single command from the command line. A command ending in
+  /// a single `&` runs in the background, see {@link jobs}. Commands
+  /// separated by `|` form a pipeline, where each stage runs concurrently
+  /// and writes to the input of the next stage via {@link output}.
+  /// Commands separated by `;` run in sequence, while `&&` and `||` run
+  /// the next command only if the previous one succeeded or failed. The
+  /// preprocessors run on each of these segments right before executing
+  /// it. Executes the command in the current mode and stores errors in
+  /// {@link last_error}. Handlers may call this overload recursively, e.g.,
+  /// to run a script, but it is not safe to call from multiple threads.
   /// @param cmd The command to process.
   /// @returns A valid result if the callback executed and an error on failure.
+  ///          Fails if any segment failed without a `||` handling it, in
+  ///          which case the error lists the message of each such segment
+  ///          on a separate line.
   command_result process(std::string const& cmd)
   {
     if (cmd.empty())
@@ -94,38 +230,152 @@ public:
       last_error_ = "command_line: mode stack is empty";
       return no_command;
     }
-    if (preprocessors_.empty())
-      return mode_stack_.back()->execute(last_error_, cmd);
-    // We use two strings here for input and output. The next best
-    // alternative would be to move the input into the preprocessor
-    // and let it return a string. However, it's very likely that our
-    // preprocessor cannot perform its operation in place, meaning that
-    // it needs a temporary string. When chaining multiple preprocessors,
-    // this design would cause each preprocessor to allocate a new string
-    // and deallocate its input. With this design, we have only two string
-    // buffers that are re-used every time. It's uglier, but way
-    // more efficient.
-    last_error_.clear();
-    std::string in = cmd;
-    std::string out;
-    for (auto& p : preprocessors_)
+    // The outer call still iterates over the buffers of ctx_ while a
+    // handler runs, hence nested calls get a context of their own.
+    if (depth_ > 0)
     {
-      p(last_error_, const_cast<const std::string&>(in), out);
-      if (! last_error_.empty())
-        return no_command;
-      if (out.empty())
-        return executed;
-      in.swap(out);
+      execution_context ctx{mode_stack_.back()};
+      ctx.token = ctx_.token;
+      return process_nested(ctx, cmd);
     }
-    return mode_stack_.back()->execute(last_error_, in);
+    ctx_.mode = mode_stack_.back();
+    if (! interruptible_)
+    {
+      ctx_.token = cancellation_token{};
+      return process_nested(ctx_, cmd);
+    }
+    interrupt_guard guard{interrupt_};
+    ctx_.token = cancellation_token{&interrupt_};
+    auto result = process_nested(ctx_, cmd);
+    if (interrupt_.cancelled())
+      last_cancel_latency_ = interrupt_.elapsed();
+    return result;
   }
 
+  /// Processes a single command in the mode of @p ctx and stores errors
+  /// in `ctx.error`. Safe to call from multiple threads concurrently,
+  /// provided that each thread uses its own context.
+  /// @param ctx The state for this call.
+  /// @param cmd The command to process.
+  /// @returns A valid result if the callback executed and an error on failure.
+  command_result process(execution_context& ctx, std::string const& cmd)
+  {
+    typename Tracer::span span{"process", cmd};
+    ctx.error.clear();
+    if (cmd.empty())
+      return nop;
+    if (ctx.mode == nullptr)
+    {
+      ctx.error = "command_line: no mode";
+      return no_command;
+    }
+    auto v = version_.load(std::memory_order_acquire);
+    if (ctx.version_ != v)
+    {
+      std::unique_lock<std::mutex> guard{mtx_};
+      ctx.registry_ = registry_;
+      ctx.version_ = version_.load(std::memory_order_relaxed);
+    }
+    auto& stats = ctx.registry_->process_stats;
+    if (! stats)
+      return process_line(ctx, cmd);
+    auto t0 = std::chrono::steady_clock::now();
+    auto result = process_line(ctx, cmd);
+    auto t1 = std::chrono::steady_clock::now();
+    stats->record(result, static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count()));
+    return result;
+  }
+
+  /// Enables statistics for {@link process} and for the commands of all
+  /// current and future modes. Statistics for `process` use the path
+  /// `(process)`, see `command::enable_stats` for command paths.
+  /// @returns The registry holding the statistics.
+  std::shared_ptr<stats_registry> enable_stats()
+  {
+    std::shared_ptr<stats_registry> result;
+    update([&](registry& reg)
+    {
+      if (! reg.stats)
+      {
+        reg.stats = std::make_shared<stats_registry>();
+        reg.process_stats = reg.stats->get("(process)");
+        for (auto& kvp : reg.modes)
+          kvp.second->root_command()->enable_stats(reg.stats);
+      }
+      result = reg.stats;
+      return true;
+    });
+    return result;
+  }
+
+  /// Returns the registry holding the statistics or `nullptr` if
+  /// statistics are disabled.
+  std::shared_ptr<stats_registry> stats() const
+  {
+    return snapshot()->stats;
+  }
+
+  /// Returns the builtin command `stats`, which prints the statistics
+  /// recorded since enabling them or since the last `stats reset`.
+  typename mode_type::cmd_clause stats_command()
+  {
+    using const_iterator = std::string::const_iterator;
+    return {
+      "stats", "prints command statistics, 'stats reset' clears them",
+      [this](std::string& err, const_iterator first, const_iterator last)
+      -> command_result
+      {
+        auto reg = stats();
+        if (! reg)
+        {
+          err = "stats: statistics are disabled";
+          return no_command;
+        }
+        if (first == last)
+        {
+          output() << reg->to_string();
+          return executed;
+        }
+        if (std::string(first, last) == "reset")
+        {
+          reg->reset();
+          return executed;
+        }
+        err = "stats: invalid argument (expected none or 'reset')";
+        return no_command;
+      }
+    };
+  }
+
+private:
+  // Executes `cmd` in the foreground or, if it ends in `&`, as a job.
+  command_result process_line(execution_context& ctx, std::string const& cmd)
+  {
+    auto cmd_end = background_marker(cmd);
+    if (cmd_end == cmd.end())
+      return run_line(*ctx.mode, *ctx.registry_, ctx.buf_, ctx.error, cmd,
+                      ctx.token);
+    if (cmd_end == cmd.begin())
+      return nop;
+    auto mptr = ctx.mode;
+    auto reg = ctx.registry_;
+    std::string in(cmd.begin(), cmd_end);
+    jobs_.spawn(in, [mptr, reg, in](std::string& err)
+    {
+      line_buffers buf;
+      return run_line(*mptr, *reg, buf, err, in, cancellation_token{});
+    });
+    return executed;
+  }
+
+public:
   /// Removes an existing mode.
   /// @param name The name of the mode.
   /// @returns `true` on success.
   bool mode_rm(std::string const& name)
   {
-    return modes_.erase(name) > 0;
+    return update([&](registry& reg) { return reg.modes.erase(name) > 0; });
   }
 
   /// Enters a given mode.
@@ -133,11 +383,13 @@ public:
   /// @returns `true` on success.
   bool mode_push(std::string const& mode)
   {
-    auto last = modes_.end();
-    auto i = modes_.find(mode);
-    if (i == last)
+    auto reg = snapshot();
+    auto i = reg->modes.find(mode);
+    if (i == reg->modes.end())
       return false;
     mode_stack_.emplace_back(i->second);
+    if (queue_)
+      attach_queue(i->second->backend(), queue_, 0);
     return true;
   }
 
@@ -159,6 +411,7 @@ public:
     auto bptr = current_backend();
     if (bptr == nullptr)
       return false;
+    typename Tracer::span span{"history"};
     bptr->history_enter(entry);
     bptr->history_save();
     return true;
@@ -181,6 +434,16 @@ public:
     auto bptr = current_backend();
     if (! bptr)
       return false;
+    // Report background jobs before showing the prompt.
+    if (queue_)
+      post_notices(jobs_, *queue_);
+    else
+      jobs_.drain_notices([](std::string const& str)
+      {
+        std::cout << str << std::endl;
+      });
+    // Pick up commands added to any parent of the current mode.
+    mode_stack_.back()->refresh();
     // Fixes TTY weirdness which may occur when switching between modes.
     bptr->reset();
     if (! bptr->read_line(line))
@@ -218,16 +481,359 @@ public:
   }
 
   /// Adds a new preprocessor to the command line. Preprocessors
-  /// intercept any input line *before* it is being passed to the
-  /// currently active mode and can manipulate the string.
+  /// intercept each segment of an input line, i.e., the text between `;`,
+  /// `&&` and `||`, *before* it is being passed to the currently active
+  /// mode and can manipulate the string.
   /// For example, a preprocessor can be used to add an engine for
   /// builtin commands or to provide variables.
+  /// Preprocessors may run concurrently if multiple threads call
+  /// {@link process}. A preprocessor is either a single stage or a
+  /// {@link preprocessor_chain}, see {@link apply_preprocessor}.
   void add_preprocessor(Preprocessor preproc)
   {
-    preprocessors_.emplace_back(std::move(preproc));
+    update([&](registry& reg)
+    {
+      reg.preprocessors.emplace_back(std::move(preproc));
+      return true;
+    });
+  }
+
+  /// Configures whether SIGINT cancels the running command. If enabled
+  /// (the default), {@link process} installs a SIGINT handler while the
+  /// command runs and passes a cancellation token to cancellable handlers.
+  /// A second SIGINT before the command returns terminates the process.
+  void set_interruptible(bool value)
+  {
+    interruptible_ = value;
+  }
+
+  /// Returns the time it took the last cancelled command to return after
+  /// receiving SIGINT.
+  std::chrono::nanoseconds last_cancel_latency() const
+  {
+    return last_cancel_latency_;
+  }
+
+  /// Returns the job control for background commands. Handlers can use
+  /// it to run work asynchronously by calling `jobs().spawn(...)`.
+  job_control& jobs()
+  {
+    return jobs_;
+  }
+
+  /// Posts job notices and the output of background jobs to @p queue as
+  /// soon as a job finishes, i.e., they appear above the prompt while the
+  /// user edits a line. Also sets @p queue on the backends of the modes on
+  /// the stack and of modes pushed later, provided the backend supports an
+  /// output queue. Without a queue, notices appear before the next prompt.
+  void set_output_queue(std::shared_ptr<output_queue> queue)
+  {
+    queue_ = queue;
+    if (! queue)
+    {
+      jobs_.on_finish(nullptr);
+      return;
+    }
+    for (auto& m : mode_stack_)
+      attach_queue(m->backend(), queue, 0);
+    // Job control outlives its workers, which call this function.
+    auto& jobs = jobs_;
+    jobs_.on_finish([&jobs, queue] { post_notices(jobs, *queue); });
+  }
+
+  /// Returns the output queue for job notices or `nullptr`.
+  std::shared_ptr<output_queue> const& get_output_queue() const
+  {
+    return queue_;
+  }
+
+  /// Returns the builtin commands `jobs`, `wait` and `fg` for inspecting
+  /// and collecting background jobs, e.g., for passing them to
+  /// `mode_type::add_all`. Interrupting `wait` or `fg` leaves the job
+  /// running in the background.
+  std::vector<typename mode_type::cmd_clause> job_commands()
+  {
+    using const_iterator = std::string::const_iterator;
+    using info = job_control::job_info;
+    std::vector<typename mode_type::cmd_clause> result;
+    result.push_back({
+      "jobs", "lists background jobs",
+      [this](std::string& err, const_iterator first, const_iterator last)
+      -> command_result
+      {
+        if (first != last)
+        {
+          err = "jobs: too many arguments (none expected)";
+          return no_command;
+        }
+        for (auto& x : jobs_.jobs())
+          output() << job_control::to_string(x) << '\n';
+        return executed;
+      }
+    });
+    result.push_back({
+      "wait", "waits for a background job or for all jobs",
+      [this](std::string& err, const_iterator first, const_iterator last,
+             cancellation_token const& token)
+      -> command_result
+      {
+        info x;
+        if (first == last)
+        {
+          while (jobs_.wait(0, x, token))
+            output() << x.output << job_control::to_string(x) << '\n';
+          if (token.cancelled())
+          {
+            err = "wait: interrupted";
+            return no_command;
+          }
+          return executed;
+        }
+        size_t id;
+        if (! parse_job_id(first, last, id))
+        {
+          err = "wait: invalid job ID";
+          return no_command;
+        }
+        if (! jobs_.wait(id, x, token))
+        {
+          err = token.cancelled() ? "wait: interrupted" : "wait: no such job";
+          return no_command;
+        }
+        output() << x.output << job_control::to_string(x) << '\n';
+        return executed;
+      }
+    });
+    result.push_back({
+      "fg", "waits for a background job and returns its result",
+      [this](std::string& err, const_iterator first, const_iterator last,
+             cancellation_token const& token)
+      -> command_result
+      {
+        size_t id = 0;
+        if (first != last && ! parse_job_id(first, last, id))
+        {
+          err = "fg: invalid job ID";
+          return no_command;
+        }
+        info x;
+        if (! jobs_.wait(id, x, token))
+        {
+          err = token.cancelled() ? "fg: interrupted" : "fg: no such job";
+          return no_command;
+        }
+        output() << x.output;
+        err = std::move(x.error);
+        return x.result;
+      }
+    });
+    return result;
   }
 
 private:
+  // Returns the current registry.
+  registry_ptr snapshot() const
+  {
+    std::unique_lock<std::mutex> guard{mtx_};
+    return registry_;
+  }
+
+  // Applies `f` to a copy of the registry and publishes the copy if
+  // `f` returns `true`.
+  template <class F>
+  bool update(F f)
+  {
+    std::unique_lock<std::mutex> guard{mtx_};
+    auto reg = std::make_shared<registry>(*registry_);
+    if (! f(*reg))
+      return false;
+    registry_ = std::move(reg);
+    version_.fetch_add(1, std::memory_order_release);
+    return true;
+  }
+
+  // Splits `line` into segments, runs the preprocessors on each segment
+  // and executes the result in `m`.
+  static command_result run_line(mode_type& m, registry const& reg,
+                                 line_buffers& buf, std::string& err,
+                                 std::string const& line,
+                                 cancellation_token const& token)
+  {
+    using iter = std::string::const_iterator;
+    if (! buf.parser.parse(err, line.begin(), line.end()))
+      return no_command;
+    auto exec = [&](std::string& stage_err, iter first, iter last)
+    {
+      return m.execute(stage_err, first, last, token);
+    };
+    auto& parser = buf.parser;
+    if (reg.preprocessors.empty())
+      return run_segments(err, buf.err, parser, token,
+                          [&](std::string& seg_err,
+                              line_parser::segment const& seg)
+                          {
+                            return run_stages(seg_err, parser.begin(seg),
+                                              parser.end(seg), exec);
+                          });
+    return run_segments(err, buf.err, parser, token,
+                        [&](std::string& seg_err,
+                            line_parser::segment const& seg)
+                        {
+                          return preprocess(reg, buf, seg_err, seg, exec,
+                                            token);
+                        });
+  }
+
+  // Runs the preprocessors on `seg` and executes the result, which may
+  // consist of multiple segments again.
+  template<class F>
+  static command_result preprocess(registry const& reg, line_buffers& buf,
+                                   std::string& err,
+                                   line_parser::segment const& seg, F& exec,
+                                   cancellation_token const& token)
+  {
+    // We use the two buffers for input and output. The next best
+    // alternative would be to move the input into the preprocessor and let
+    // it return a string. However, it's very likely that our preprocessor
+    // cannot perform its operation in place, meaning that it needs a
+    // temporary string. When chaining multiple preprocessors, this design
+    // would cause each preprocessor to allocate a new string and deallocate
+    // its input. With this design, we have only two string buffers that
+    // are re-used every time. It's uglier, but way more efficient. Stages
+    // that leave the segment unchanged write nothing.
+    buf.in.assign(buf.parser.begin(seg)->first,
+                  (buf.parser.end(seg) - 1)->second);
+    std::string const* line = &buf.in;
+    for (auto& p : reg.preprocessors)
+    {
+      typename Tracer::span span{"preprocessor"};
+      auto result = apply_preprocessor(p, err, line, buf.in, buf.out);
+      if (! err.empty())
+        return no_command;
+      if (result == line_consumed)
+        return executed;
+    }
+    auto& parser = buf.stage_parser;
+    if (! parser.parse(err, line->begin(), line->end()))
+      return no_command;
+    return run_segments(err, buf.stage_err, parser, token,
+                        [&](std::string& stage_err,
+                            line_parser::segment const& x)
+                        {
+                          return run_stages(stage_err, parser.begin(x),
+                                            parser.end(x), exec);
+                        });
+  }
+
+  // Runs the segments of `parser` according to their connectors, passing
+  // an error buffer and the segment to `f`. Collects the errors of failed
+  // segments in `err`, unless a subsequent `||` handles the failure.
+  template<class F>
+  static command_result run_segments(std::string& err, std::string& seg_err,
+                                     line_parser const& parser,
+                                     cancellation_token const& token, F f)
+  {
+    auto result = nop;
+    size_t failures = 0;
+    size_t mark = 0;
+    for (auto& seg : parser.segments())
+    {
+      if (token.cancelled()
+          || (seg.connector == run_on_success && result == no_command)
+          || (seg.connector == run_on_failure && result != no_command))
+        continue;
+      if (seg.connector == run_on_failure)
+      {
+        --failures;
+        err.resize(mark);
+      }
+      seg_err.clear();
+      result = f(seg_err, seg);
+      if (result != no_command)
+        continue;
+      ++failures;
+      mark = err.size();
+      if (! seg_err.empty())
+      {
+        if (! err.empty())
+          err += '\n';
+        err += seg_err;
+      }
+    }
+    return failures > 0 ? no_command : result;
+  }
+
+  // Executes a single command or a pipeline.
+  template<class Iterator, class F>
+  static command_result run_stages(std::string& err, Iterator first,
+                                   Iterator last, F& exec)
+  {
+    if (last - first == 1)
+      return exec(err, first->first, first->second);
+    return run_pipeline(err, first, last, exec);
+  }
+
+  // Returns the end of the command if `cmd` ends with a single `&`
+  // and `cmd.end()` otherwise.
+  static std::string::const_iterator background_marker(std::string const& cmd)
+  {
+    auto not_space = [](char c) { return ! isspace(c); };
+    auto i = std::find_if(cmd.rbegin(), cmd.rend(), not_space);
+    if (i == cmd.rend() || *i != '&')
+      return cmd.end();
+    ++i;
+    // Neither `&&` nor an escaped `\&` put the command into the background.
+    if (i != cmd.rend() && (*i == '&' || *i == '\\'))
+      return cmd.end();
+    return std::find_if(i, cmd.rend(), not_space).base();
+  }
+
+  // Parses job IDs in the format "42" or "%42".
+  static bool parse_job_id(std::string::const_iterator first,
+                           std::string::const_iterator last, size_t& id)
+  {
+    std::string str(first, last);
+    auto cstr = str.c_str();
+    if (*cstr == '%')
+      ++cstr;
+    char* end = nullptr;
+    id = std::strtoul(cstr, &end, 10);
+    return end != cstr && *end == '\0' && id != 0;
+  }
+
+  static void post_notices(job_control& jobs, output_queue& queue)
+  {
+    jobs.drain_notices([&](std::string const& str)
+    {
+      queue.post("jobs", str);
+    });
+  }
+
+  // Sets the output queue on backends that support one.
+  template<class B>
+  static auto attach_queue(B& backend,
+                           std::shared_ptr<output_queue> const& queue, int)
+  -> decltype(backend.set_output_queue(queue))
+  {
+    backend.set_output_queue(queue);
+  }
+
+  template<class B>
+  static void attach_queue(B&, std::shared_ptr<output_queue> const&, long)
+  {
+    // nop
+  }
+
+  // process `cmd` with `ctx` and publish its error as last_error_
+  command_result process_nested(execution_context& ctx, std::string const& cmd)
+  {
+    ++depth_;
+    auto result = process(ctx, cmd);
+    --depth_;
+    last_error_ = ctx.error;
+    return result;
+  }
+
   // get the current backend or nullptr if mode stack is empty
   Backend* current_backend()
   {
@@ -235,10 +841,19 @@ private:
   }
 
   std::vector<std::shared_ptr<mode_type>> mode_stack_;
-  std::map<std::string, std::shared_ptr<mode_type>> modes_;
+  mutable std::mutex mtx_;
+  registry_ptr registry_;
+  std::atomic<uint64_t> version_;
   backend_ptr backend_;
+  execution_context ctx_;
   std::string last_error_;
-  std::vector<Preprocessor> preprocessors_;
+  size_t depth_;
+  bool interruptible_;
+  cancellation_source interrupt_;
+  std::chrono::nanoseconds last_cancel_latency_;
+  std::shared_ptr<output_queue> queue_;
+  // Declared last, so background jobs terminate before anything else.
+  job_control jobs_;
 };
 
 } // namespace sash
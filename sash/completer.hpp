@@ -22,6 +22,7 @@
 #include <string>
 #include <vector>
 #include <algorithm>
+#include <functional>
 
 namespace sash {
 
@@ -49,6 +50,12 @@ class completer
 public:
   using callback_type = CompletionCallback;
 
+  /// A function that appends all candidates for a line to its second
+  /// argument. Each candidate is a complete line starting with the same
+  /// text as the line up to the word under the cursor.
+  using source_type =
+    std::function<void (std::string const&, std::vector<std::string>&)>;
+
   /// Adds a string to complete.
   /// @param str The string to complete.
   /// @returns `true` if *str* did not already exist.
@@ -81,6 +88,14 @@ public:
     strings_.swap(completions);
   }
 
+  /// Sets a source for candidates that depend on the line, e.g., the
+  /// arguments of a command. Candidates from the source follow the
+  /// matching registered strings.
+  void set_source(source_type f)
+  {
+    source_ = std::move(f);
+  }
+
   /// Sets a callback handler for the list of matches.
   /// @param f The function to execute for matching completions.
   void on_completion(CompletionCallback f)
@@ -95,18 +110,21 @@ public:
                              std::string const& prefix) const {
     if (!callback_)
       return no_completion;
-    if (strings_.empty())
+    if (strings_.empty() && !source_)
       return not_found;
     std::vector<std::string> matches;
     for (auto& str : strings_)
       if (str.compare(0, prefix.size(), prefix) == 0)
         matches.push_back(str);
+    if (source_)
+      source_(prefix, matches);
     result = callback_(prefix, std::move(matches));
     return completed;
   }
 
 private:
   std::vector<std::string> strings_;
+  source_type source_;
   CompletionCallback callback_;
 };
 
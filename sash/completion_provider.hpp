@@ -0,0 +1,334 @@
+/******************************************************************************
+ *                   ____     ______   ____     __  __                        *
+ *                  /\  _`\  /\  _  \ /\  _`\  /\ \/\ \                       *
+ *                  \ \,\L\_\\ \ \L\ \\ \,\L\_\\ \ \_\ \                      *
+ *                   \/_\__ \ \ \  __ \\/_\__ \ \ \  _  \                     *
+ *                     /\ \L\ \\ \ \/\ \ /\ \L\ \\ \ \ \ \                    *
+ *                     \ `\____\\ \_\ \_\\ `\____\\ \_\ \_\                   *
+ *                      \/_____/ \/_/\/_/ \/_____/ \/_/\/_/                   *
+ *                                                                            *
+ *                                                                            *
+ * Copyright (c) 2014                                                         *
+ * Matthias Vallentin <vallentin (at) icir.org>                               *
+ * Dominik Charousset <dominik.charousset (at) haw-hamburg.de>                *
+ *                                                                            *
+ * Distributed under the 3-clause BSD License.                                *
+ * See accompanying file LICENSE.                                             *
+\******************************************************************************/
+
+#ifndef SASH_COMPLETION_PROVIDER_HPP
+#define SASH_COMPLETION_PROVIDER_HPP
+
+#include <map>
+#include <mutex>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <iterator>
+#include <algorithm>
+#include <functional>
+#include <condition_variable>
+
+#include "sash/worker_pool.hpp"
+
+namespace sash {
+
+/// Provides argument completions from a slow source, e.g., a remote
+/// inventory, without blocking the command line for longer than a deadline.
+/// Results are cached per context with a time-to-live. Requests for a
+/// missing or expired entry fetch on a worker thread and wait until the
+/// deadline at most. When late, the completion falls back to the cached
+/// entry, if any, and the pending fetch updates the cache in the
+/// background. Entries older than half their time-to-live are refreshed
+/// in the background while still being served from the cache.
+///
+/// The cache holds a bounded number of contexts and evicts expired entries
+/// first, then the least recently used ones. A fetch that does not return
+/// within the fetch timeout counts as stuck: the provider stops waiting for
+/// it and fetches the context again on the next request.
+///
+/// The context of a completion is the argument text before the word under
+/// the cursor. Candidates are sorted and selected by the word under the
+/// cursor with a binary search. Instances are cheap to copy and all copies
+/// share one cache, i.e., a provider can be passed to
+/// `command::on_complete_args` directly.
+class async_completion_provider
+{
+public:
+  /// An iterator to the command line input.
+  using const_iterator = std::string::const_iterator;
+
+  /// The clock for deadlines and expiration.
+  using clock = std::chrono::steady_clock;
+
+  /// Fetches all candidates for a context into the second argument.
+  /// Returns `false` on failure, which keeps the cached entry.
+  using fetch_function =
+    std::function<bool (std::string const&, std::vector<std::string>&)>;
+
+  /// The maximum number of concurrent fetches without a worker pool.
+  static constexpr size_t max_threads = 4;
+
+  /// Constructs a provider.
+  /// @param fetch The function retrieving candidates, called on @p pool.
+  /// @param deadline The maximum time a completion waits for a fetch.
+  /// @param ttl The time after which a cached entry expires.
+  /// @param pool The workers for fetching or `nullptr` to fetch on detached
+  ///             threads, at most `max_threads` at a time not counting
+  ///             stuck fetches. A stuck fetch on a pool blocks its worker.
+  /// @param fetch_timeout The time after which a fetch counts as stuck.
+  /// @param max_entries The maximum number of cached contexts.
+  async_completion_provider(fetch_function fetch,
+                            clock::duration deadline
+                              = std::chrono::milliseconds(100),
+                            clock::duration ttl = std::chrono::seconds(30),
+                            std::shared_ptr<worker_pool> pool = nullptr,
+                            clock::duration fetch_timeout
+                              = std::chrono::seconds(10),
+                            size_t max_entries = 256)
+    : state_{std::make_shared<state>(std::move(fetch), deadline, ttl,
+                                     fetch_timeout, max_entries)},
+      pool_{std::move(pool)}
+  {
+    // nop
+  }
+
+  /// Returns the candidates for the arguments `[first, last)`.
+  std::vector<std::string> operator()(const_iterator first,
+                                      const_iterator last) const
+  {
+    auto word = std::find(std::reverse_iterator<const_iterator>(last),
+                          std::reverse_iterator<const_iterator>(first),
+                          ' ').base();
+    return get(std::string(first, word), std::string(word, last));
+  }
+
+  /// Returns the candidates for @p context starting with @p prefix.
+  std::vector<std::string> get(std::string const& context,
+                               std::string const& prefix = "") const
+  {
+    auto now = clock::now();
+    std::unique_lock<std::mutex> guard{state_->mtx};
+    // Waiting keeps the entry alive even if it gets evicted meanwhile.
+    auto e = state_->lookup(context, now);
+    e->used = now;
+    if (e->fetched && now - e->updated < state_->ttl)
+    {
+      ++state_->hits;
+      if (now - e->updated >= state_->ttl / 2)
+        start_fetch(context, e, now);
+      return select(e->values, prefix);
+    }
+    ++state_->misses;
+    auto generation = e->generation;
+    start_fetch(context, e, now);
+    auto done = [&] { return e->generation != generation; };
+    if (! state_->cv.wait_until(guard, now + state_->deadline, done))
+      ++state_->late;
+    return select(e->values, prefix);
+  }
+
+  /// Drops all cached entries. Pending fetches no longer update the cache.
+  void clear()
+  {
+    std::unique_lock<std::mutex> guard{state_->mtx};
+    state_->entries.clear();
+  }
+
+  /// Returns the number of cached contexts.
+  size_t size() const
+  {
+    std::unique_lock<std::mutex> guard{state_->mtx};
+    return state_->entries.size();
+  }
+
+  /// Returns the number of completions served from a fresh cache entry.
+  size_t hits() const
+  {
+    std::unique_lock<std::mutex> guard{state_->mtx};
+    return state_->hits;
+  }
+
+  /// Returns the number of completions that had to fetch.
+  size_t misses() const
+  {
+    std::unique_lock<std::mutex> guard{state_->mtx};
+    return state_->misses;
+  }
+
+  /// Returns the number of fetches that missed their deadline.
+  size_t late() const
+  {
+    std::unique_lock<std::mutex> guard{state_->mtx};
+    return state_->late;
+  }
+
+  /// Returns the number of fetches that exceeded the fetch timeout.
+  size_t stuck() const
+  {
+    std::unique_lock<std::mutex> guard{state_->mtx};
+    return state_->stuck;
+  }
+
+private:
+  struct entry
+  {
+    entry() : fetched{false}, pending{false}, fetch_id{0}, generation{0}
+    {
+      // nop
+    }
+
+    bool fetched;
+    bool pending;
+    // Identifies the latest fetch, i.e., the one that clears `pending`.
+    size_t fetch_id;
+    // Incremented whenever a fetch completes.
+    size_t generation;
+    clock::time_point started;
+    clock::time_point updated;
+    clock::time_point used;
+    std::vector<std::string> values;
+  };
+
+  using entry_ptr = std::shared_ptr<entry>;
+
+  struct state
+  {
+    state(fetch_function f, clock::duration dl, clock::duration tl,
+          clock::duration ft, size_t n)
+      : fetch{std::move(f)},
+        deadline{dl},
+        ttl{tl},
+        fetch_timeout{ft},
+        max_entries{n > 0 ? n : 1},
+        hits{0},
+        misses{0},
+        late{0},
+        stuck{0}
+    {
+      // nop
+    }
+
+    // Returns the entry for @p context, evicting entries to make room for
+    // a new one if necessary.
+    // @pre `mtx` is locked
+    entry_ptr lookup(std::string const& context, clock::time_point now)
+    {
+      auto i = entries.find(context);
+      if (i != entries.end())
+        return i->second;
+      if (entries.size() >= max_entries)
+        evict(now);
+      auto e = std::make_shared<entry>();
+      entries.emplace(context, e);
+      return e;
+    }
+
+    // Drops expired entries or, if there are none, the least recently used
+    // one. Fetches keep their entry alive until they complete.
+    void evict(clock::time_point now)
+    {
+      for (auto i = entries.begin(); i != entries.end();)
+      {
+        auto& e = *i->second;
+        if (e.fetched && now - e.updated >= ttl && ! e.pending)
+          i = entries.erase(i);
+        else
+          ++i;
+      }
+      if (entries.size() < max_entries)
+        return;
+      auto lru = entries.begin();
+      for (auto i = entries.begin(); i != entries.end(); ++i)
+        if (i->second->used < lru->second->used)
+          lru = i;
+      entries.erase(lru);
+    }
+
+    // Returns the number of fetches that are pending and not stuck.
+    size_t running(clock::time_point now) const
+    {
+      size_t n = 0;
+      for (auto& kvp : entries)
+        if (kvp.second->pending && now - kvp.second->started < fetch_timeout)
+          ++n;
+      return n;
+    }
+
+    fetch_function fetch;
+    clock::duration deadline;
+    clock::duration ttl;
+    clock::duration fetch_timeout;
+    size_t max_entries;
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::map<std::string, entry_ptr> entries;
+    size_t hits;
+    size_t misses;
+    size_t late;
+    size_t stuck;
+  };
+
+  static std::vector<std::string> select(std::vector<std::string> const& xs,
+                                         std::string const& prefix)
+  {
+    std::vector<std::string> result;
+    auto i = std::lower_bound(xs.begin(), xs.end(), prefix);
+    for (; i != xs.end() && i->compare(0, prefix.size(), prefix) == 0; ++i)
+      result.push_back(*i);
+    return result;
+  }
+
+  // Starts a fetch for @p context unless one is pending and not stuck.
+  // @pre `state_->mtx` is locked
+  void start_fetch(std::string const& context, entry_ptr const& e,
+                   clock::time_point now) const
+  {
+    if (e->pending)
+    {
+      if (now - e->started < state_->fetch_timeout)
+        return;
+      ++state_->stuck;
+    }
+    if (! pool_ && state_->running(now) >= max_threads)
+      return;
+    e->pending = true;
+    e->started = now;
+    auto id = ++e->fetch_id;
+    // Tasks keep the state alive, since they may outlive this provider.
+    auto st = state_;
+    auto task = [st, context, e, id]
+    {
+      std::vector<std::string> values;
+      auto ok = st->fetch(context, values);
+      // Sorted values allow for selecting a prefix with a binary search.
+      std::sort(values.begin(), values.end());
+      std::unique_lock<std::mutex> guard{st->mtx};
+      if (e->fetch_id == id)
+        e->pending = false;
+      ++e->generation;
+      if (ok)
+      {
+        e->fetched = true;
+        e->updated = clock::now();
+        e->values.swap(values);
+      }
+      st->cv.notify_all();
+    };
+    if (pool_)
+      pool_->submit(std::move(task));
+    else
+      std::thread{std::move(task)}.detach();
+  }
+
+  std::shared_ptr<state> state_;
+  std::shared_ptr<worker_pool> pool_;
+};
+
+constexpr size_t async_completion_provider::max_threads;
+
+} // namespace sash
+
+#endif // SASH_COMPLETION_PROVIDER_HPP
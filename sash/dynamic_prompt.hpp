@@ -0,0 +1,193 @@
+/******************************************************************************
+ *                   ____     ______   ____     __  __                        *
+ *                  /\  _`\  /\  _  \ /\  _`\  /\ \/\ \                       *
+ *                  \ \,\L\_\\ \ \L\ \\ \,\L\_\\ \ \_\ \                      *
+ *                   \/_\__ \ \ \  __ \\/_\__ \ \ \  _  \                     *
+ *                     /\ \L\ \\ \ \/\ \ /\ \L\ \\ \ \ \ \                    *
+ *                     \ `\____\\ \_\ \_\\ `\____\\ \_\ \_\                   *
+ *                      \/_____/ \/_/\/_/ \/_____/ \/_/\/_/                   *
+ *                                                                            *
+ *                                                                            *
+ * Copyright (c) 2014                                                         *
+ * Matthias Vallentin <vallentin (at) icir.org>                               *
+ * Dominik Charousset <dominik.charousset (at) haw-hamburg.de>                *
+ *                                                                            *
+ * Distributed under the 3-clause BSD License.                                *
+ * See accompanying file LICENSE.                                             *
+\******************************************************************************/
+
+#ifndef SASH_DYNAMIC_PROMPT_HPP
+#define SASH_DYNAMIC_PROMPT_HPP
+
+#include <atomic>
+#include <string>
+#include <vector>
+#include <cctype>
+#include <cassert>
+#include <cstdint>
+#include <functional>
+
+#include "sash/color.hpp"
+#include "sash/style.hpp"
+
+namespace sash {
+
+/// A prompt composed of segments, e.g., the current mode, the cluster leader
+/// and the latency of the last command. Each segment has a provider that
+/// computes its text and a dirty flag. Rendering calls only the providers
+/// of dirty segments and rebuilds the prompt only if a text changed, i.e.,
+/// rendering an unchanged prompt merely checks an atomic bitmask and returns
+/// the same buffer. Backends render the prompt on each redraw.
+///
+/// Segments must be added before rendering the prompt for the first time,
+/// while {@link invalidate} is safe to call from any thread.
+class dynamic_prompt
+{
+  dynamic_prompt(dynamic_prompt const&) = delete;
+  dynamic_prompt& operator=(dynamic_prompt const&) = delete;
+
+public:
+  /// Computes the text of a segment by assigning to the argument, which
+  /// holds the previous text, i.e., providers can reuse its capacity.
+  using provider = std::function<void (std::string&)>;
+
+  /// The maximum number of segments.
+  static constexpr size_t max_segments = 64;
+
+  /// The ID returned for segments exceeding {@link max_segments}.
+  static constexpr size_t invalid_id = static_cast<size_t>(-1);
+
+  /// Constructs an empty prompt.
+  /// @param capacity The initial capacity of the prompt buffer.
+  /// @param colors Whether to render the colors of segments.
+  explicit dynamic_prompt(size_t capacity = 256,
+                          bool colors = terminal::colors(STDOUT_FILENO))
+    : colors_{colors},
+      dirty_{0},
+      width_{0},
+      renders_{0}
+  {
+    buffer_.reserve(capacity);
+  }
+
+  /// Adds a segment computed by @p f and rendered in color @p c.
+  /// @returns The ID of the segment for {@link invalidate}, or
+  ///          {@link invalid_id} if the prompt has `max_segments` already.
+  size_t add(provider f, color::type c = color::none)
+  {
+    assert(segments_.size() < max_segments);
+    if (segments_.size() == max_segments)
+      return invalid_id;
+    segments_.push_back(segment{std::move(f), c, std::string{}});
+    auto id = segments_.size() - 1;
+    invalidate(id);
+    return id;
+  }
+
+  /// Adds a segment with the constant text @p str.
+  size_t add_text(std::string str, color::type c = color::none)
+  {
+    return add([str](std::string& x) { x = str; }, c);
+  }
+
+  /// Marks segment @p id as dirty, i.e., the next {@link render} calls its
+  /// provider again.
+  void invalidate(size_t id)
+  {
+    if (id < max_segments)
+      dirty_.fetch_or(uint64_t{1} << id, std::memory_order_release);
+  }
+
+  /// Marks all segments as dirty.
+  void invalidate()
+  {
+    dirty_.store(~uint64_t{0}, std::memory_order_release);
+  }
+
+  /// Returns the prompt after updating all dirty segments.
+  std::string const& render()
+  {
+    if (dirty_.load(std::memory_order_relaxed) == 0)
+      return buffer_;
+    auto mask = dirty_.exchange(0, std::memory_order_acquire);
+    auto changed = false;
+    for (size_t i = 0; i < segments_.size(); ++i)
+    {
+      if ((mask & (uint64_t{1} << i)) == 0)
+        continue;
+      auto& s = segments_[i];
+      scratch_ = s.text;
+      s.f(scratch_);
+      if (scratch_ != s.text)
+      {
+        s.text.swap(scratch_);
+        changed = true;
+      }
+    }
+    if (changed)
+      rebuild();
+    return buffer_;
+  }
+
+  /// Returns the number of columns of the last line of the prompt as of
+  /// the last call to {@link render}.
+  size_t width() const
+  {
+    return width_;
+  }
+
+  /// Returns how often the prompt has been rebuilt.
+  uint64_t renders() const
+  {
+    return renders_;
+  }
+
+private:
+  struct segment
+  {
+    provider f;
+    color::type c;
+    std::string text;
+  };
+
+  void rebuild()
+  {
+    ++renders_;
+    buffer_.clear();
+    for (auto& s : segments_)
+      append_styled(buffer_, s.c, s.text, colors_);
+    width_ = 0;
+    for (size_t i = 0; i < buffer_.size(); ++i)
+    {
+      auto c = static_cast<unsigned char>(buffer_[i]);
+      if (c == '\n')
+      {
+        width_ = 0;
+      }
+      else if (c == '\033')
+      {
+        // Skip escape sequences such as colors.
+        while (i + 1 < buffer_.size()
+               && ! std::isalpha(static_cast<unsigned char>(buffer_[i + 1])))
+          ++i;
+        ++i;
+      }
+      else if ((c & 0xC0) != 0x80)
+      {
+        ++width_;
+      }
+    }
+  }
+
+  bool colors_;
+  std::vector<segment> segments_;
+  std::atomic<uint64_t> dirty_;
+  std::string buffer_;
+  std::string scratch_;
+  size_t width_;
+  uint64_t renders_;
+};
+
+} // namespace sash
+
+#endif // SASH_DYNAMIC_PROMPT_HPP
@@ -0,0 +1,138 @@
+/******************************************************************************
+ *                   ____     ______   ____     __  __                        *
+ *                  /\  _`\  /\  _  \ /\  _`\  /\ \/\ \                       *
+ *                  \ \,\L\_\\ \ \L\ \\ \,\L\_\\ \ \_\ \                      *
+ *                   \/_\__ \ \ \  __ \\/_\__ \ \ \  _  \                     *
+ *                     /\ \L\ \\ \ \/\ \ /\ \L\ \\ \ \ \ \                    *
+ *                     \ `\____\\ \_\ \_\\ `\____\\ \_\ \_\                   *
+ *                      \/_____/ \/_/\/_/ \/_____/ \/_/\/_/                   *
+ *                                                                            *
+ *                                                                            *
+ * Copyright (c) 2014                                                         *
+ * Matthias Vallentin <vallentin (at) icir.org>                               *
+ * Dominik Charousset <dominik.charousset (at) haw-hamburg.de>                *
+ *                                                                            *
+ * Distributed under the 3-clause BSD License.                                *
+ * See accompanying file LICENSE.                                             *
+\******************************************************************************/
+
+#ifndef SASH_HISTORY_INDEX_HPP
+#define SASH_HISTORY_INDEX_HPP
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+namespace sash {
+
+/// A prefix index over history entries. Each node of the underlying trie
+/// stores the most recent entry of its subtree, i.e., looking up the most
+/// recent entry for a prefix costs `O(prefix length)` regardless of the
+/// number of entries. Adding an entry costs `O(entry length)`.
+class history_index
+{
+public:
+  history_index()
+  {
+    clear();
+  }
+
+  /// Adds @p entry as the most recent history entry.
+  void add(std::string const& entry)
+  {
+    if (entry.empty())
+      return;
+    uint32_t pos = 0;
+    for (auto c : entry)
+    {
+      auto next = find_child(pos, c);
+      pos = next != npos ? next : make_child(pos, c);
+    }
+    auto& id = nodes_[pos].entry;
+    if (id == npos)
+    {
+      id = static_cast<uint32_t>(entries_.size());
+      entries_.push_back(entry);
+    }
+    // The entry is now the most recent one for each of its prefixes.
+    auto most_recent = id;
+    pos = 0;
+    for (auto c : entry)
+    {
+      pos = find_child(pos, c);
+      nodes_[pos].best = most_recent;
+    }
+  }
+
+  /// Returns the most recent entry starting with `[first, last)`, or
+  /// `nullptr` if no such entry exists or if the range is empty.
+  std::string const* lookup(char const* first, char const* last) const
+  {
+    if (first == last)
+      return nullptr;
+    uint32_t pos = 0;
+    for (; first != last; ++first)
+    {
+      pos = find_child(pos, *first);
+      if (pos == npos)
+        return nullptr;
+    }
+    return &entries_[nodes_[pos].best];
+  }
+
+  /// Returns the most recent entry starting with @p prefix.
+  std::string const* lookup(std::string const& prefix) const
+  {
+    return lookup(prefix.data(), prefix.data() + prefix.size());
+  }
+
+  /// Returns the number of distinct entries in the index.
+  size_t size() const
+  {
+    return entries_.size();
+  }
+
+  /// Removes all entries.
+  void clear()
+  {
+    nodes_.clear();
+    nodes_.push_back(node{npos, npos, npos, npos, '\0'});
+    entries_.clear();
+  }
+
+private:
+  static constexpr uint32_t npos = static_cast<uint32_t>(-1);
+
+  struct node
+  {
+    uint32_t first_child;
+    uint32_t next_sibling;
+    uint32_t best;  // most recent entry in this subtree
+    uint32_t entry; // entry ending at this node
+    char c;
+  };
+
+  uint32_t find_child(uint32_t pos, char c) const
+  {
+    for (auto i = nodes_[pos].first_child; i != npos;
+         i = nodes_[i].next_sibling)
+      if (nodes_[i].c == c)
+        return i;
+    return npos;
+  }
+
+  uint32_t make_child(uint32_t pos, char c)
+  {
+    auto id = static_cast<uint32_t>(nodes_.size());
+    nodes_.push_back(node{npos, nodes_[pos].first_child, npos, npos, c});
+    nodes_[pos].first_child = id;
+    return id;
+  }
+
+  std::vector<node> nodes_;
+  std::vector<std::string> entries_;
+};
+
+} // namespace sash
+
+#endif // SASH_HISTORY_INDEX_HPP
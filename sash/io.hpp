@@ -0,0 +1,118 @@
+/******************************************************************************
+ *                   ____     ______   ____     __  __                        *
+ *                  /\  _`\  /\  _  \ /\  _`\  /\ \/\ \                       *
+ *                  \ \,\L\_\\ \ \L\ \\ \,\L\_\\ \ \_\ \                      *
+ *                   \/_\__ \ \ \  __ \\/_\__ \ \ \  _  \                     *
+ *                     /\ \L\ \\ \ \/\ \ /\ \L\ \\ \ \ \ \                    *
+ *                     \ `\____\\ \_\ \_\\ `\____\\ \_\ \_\                   *
+ *                      \/_____/ \/_/\/_/ \/_____/ \/_/\/_/                   *
+ *                                                                            *
+ *                                                                            *
+ * Copyright (c) 2014                                                         *
+ * Matthias Vallentin <vallentin (at) icir.org>                               *
+ * Dominik Charousset <dominik.charousset (at) haw-hamburg.de>                *
+ *                                                                            *
+ * Distributed under the 3-clause BSD License.                                *
+ * See accompanying file LICENSE.                                             *
+\******************************************************************************/
+
+#ifndef SASH_IO_HPP
+#define SASH_IO_HPP
+
+#include <string>
+#include <istream>
+#include <ostream>
+#include <iostream>
+#include <streambuf>
+
+namespace sash {
+
+/// A stream buffer appending to a string.
+class string_writer : public std::streambuf
+{
+public:
+  explicit string_writer(std::string& str) : str_(str)
+  {
+    // nop
+  }
+
+protected:
+  int_type overflow(int_type c) override
+  {
+    if (! traits_type::eq_int_type(c, traits_type::eof()))
+      str_ += traits_type::to_char_type(c);
+    return traits_type::not_eof(c);
+  }
+
+  std::streamsize xsputn(char const* s, std::streamsize n) override
+  {
+    str_.append(s, static_cast<size_t>(n));
+    return n;
+  }
+
+private:
+  std::string& str_;
+};
+
+namespace detail {
+
+inline std::ostream*& output_ptr()
+{
+  static thread_local std::ostream* ptr = nullptr;
+  return ptr;
+}
+
+inline std::istream*& input_ptr()
+{
+  static thread_local std::istream* ptr = nullptr;
+  return ptr;
+}
+
+} // namespace detail
+
+/// Returns the output sink for command handlers on this thread. Inside a
+/// pipeline, this is the input of the next stage, otherwise `std::cout`.
+/// Handlers should write here rather than to `std::cout` directly.
+inline std::ostream& output()
+{
+  auto ptr = detail::output_ptr();
+  return ptr != nullptr ? *ptr : std::cout;
+}
+
+/// Returns the input of the current pipeline stage on this thread or
+/// `nullptr` if the handler does not receive piped input.
+inline std::istream* input()
+{
+  return detail::input_ptr();
+}
+
+/// Redirects {@link output} and {@link input} for the current thread
+/// while in scope.
+class io_redirect
+{
+  io_redirect(io_redirect const&) = delete;
+  io_redirect& operator=(io_redirect const&) = delete;
+
+public:
+  io_redirect(std::ostream* out, std::istream* in)
+    : prev_out_{detail::output_ptr()},
+      prev_in_{detail::input_ptr()}
+  {
+    detail::output_ptr() = out;
+    detail::input_ptr() = in;
+  }
+
+  ~io_redirect()
+  {
+    detail::output_ptr() = prev_out_;
+    detail::input_ptr() = prev_in_;
+  }
+
+private:
+  std::ostream* prev_out_;
+  std::istream* prev_in_;
+};
+
+} // namespace sash
+
+#endif // SASH_IO_HPP
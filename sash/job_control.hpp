@@ -0,0 +1,331 @@
+/******************************************************************************
+ *                   ____     ______   ____     __  __                        *
+ *                  /\  _`\  /\  _  \ /\  _`\  /\ \/\ \                       *
+ *                  \ \,\L\_\\ \ \L\ \\ \,\L\_\\ \ \_\ \                      *
+ *                   \/_\__ \ \ \  __ \\/_\__ \ \ \  _  \                     *
+ *                     /\ \L\ \\ \ \/\ \ /\ \L\ \\ \ \ \ \                    *
+ *                     \ `\____\\ \_\ \_\\ `\____\\ \_\ \_\                   *
+ *                      \/_____/ \/_/\/_/ \/_____/ \/_/\/_/                   *
+ *                                                                            *
+ *                                                                            *
+ * Copyright (c) 2014                                                         *
+ * Matthias Vallentin <vallentin (at) icir.org>                               *
+ * Dominik Charousset <dominik.charousset (at) haw-hamburg.de>                *
+ *                                                                            *
+ * Distributed under the 3-clause BSD License.                                *
+ * See accompanying file LICENSE.                                             *
+\******************************************************************************/
+
+#ifndef SASH_JOB_CONTROL_HPP
+#define SASH_JOB_CONTROL_HPP
+
+#include <mutex>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+#include <ostream>
+#include <algorithm>
+#include <functional>
+#include <condition_variable>
+
+#include "sash/io.hpp"
+#include "sash/command.hpp"
+#include "sash/cancellation.hpp"
+#include "sash/worker_pool.hpp"
+
+namespace sash {
+
+/// The state of a background job.
+enum job_state
+{
+  job_running,
+  job_done,
+  job_failed
+};
+
+/// Runs commands in the background on a pool of worker threads and keeps
+/// track of their state. Each job writes to its own buffer via
+/// {@link output}, i.e., jobs neither interleave their output nor draw over
+/// the prompt. The output appears with the notice for the finished job.
+/// Finished jobs remain in the job table until collected via {@link wait},
+/// except that the table drops the oldest jobs beyond `max_finished` once
+/// they have been reported via {@link drain_notices}. Several job controls
+/// can share one pool via {@link set_pool}, in which case destroying a job
+/// control leaves its running jobs to the pool instead of waiting for them.
+class job_control
+{
+  job_control(job_control const&) = delete;
+  job_control& operator=(job_control const&) = delete;
+
+public:
+  /// The type of a job. The function receives an error buffer and
+  /// returns the result of the command.
+  using job_fun = std::function<command_result (std::string&)>;
+
+  /// Describes a single job.
+  struct job_info
+  {
+    size_t id;
+    std::string line;
+    job_state state;
+    command_result result;
+    std::string error;
+    /// Everything the job wrote to {@link output} until reported.
+    std::string output;
+    /// Whether {@link drain_notices} reported the finished job.
+    bool reported;
+  };
+
+  /// The maximum number of finished and reported jobs in the job table.
+  static constexpr size_t max_finished = 64;
+
+  /// Constructs a job control with @p num_workers worker threads, or with
+  /// one worker per core if @p num_workers is 0. The threads are started
+  /// when spawning the first job.
+  explicit job_control(size_t num_workers = 0)
+    : num_workers_{num_workers},
+      next_id_{1},
+      st_{std::make_shared<state>()}
+  {
+    // nop
+  }
+
+  /// Waits for running jobs unless the pool is shared, in which case the
+  /// jobs finish in the background without calling the `on_finish` hook.
+  ~job_control()
+  {
+    on_finish(nullptr);
+  }
+
+  /// Sets the number of worker threads.
+  /// @returns `false` if the workers have already been started.
+  bool set_workers(size_t num_workers)
+  {
+    std::unique_lock<std::mutex> guard{st_->mtx};
+    if (pool_)
+      return false;
+    num_workers_ = num_workers;
+    return true;
+  }
+
+  /// Runs jobs on @p pool instead of starting worker threads of our own.
+  /// @returns `false` if the workers have already been started.
+  bool set_pool(std::shared_ptr<worker_pool> pool)
+  {
+    std::unique_lock<std::mutex> guard{st_->mtx};
+    if (pool_)
+      return false;
+    pool_ = std::move(pool);
+    return true;
+  }
+
+  /// Calls @p f on the worker thread after each job finished, e.g., for
+  /// reporting jobs via {@link drain_notices} right away. Returns after
+  /// any running call to the previous function.
+  void on_finish(std::function<void ()> f)
+  {
+    std::unique_lock<std::mutex> guard{st_->finish_mtx};
+    st_->on_finish = std::move(f);
+  }
+
+  /// Runs @p f in the background.
+  /// @param line The command line for reporting the state of the job.
+  /// @param f The job to run.
+  /// @returns The ID of the new job.
+  size_t spawn(std::string line, job_fun f)
+  {
+    size_t id;
+    worker_pool* pool;
+    {
+      std::unique_lock<std::mutex> guard{st_->mtx};
+      if (! pool_)
+        pool_ = std::make_shared<worker_pool>(num_workers_);
+      pool = pool_.get();
+      id = next_id_++;
+      st_->jobs.push_back(job_info{id, std::move(line), job_running, executed,
+                                   std::string{}, std::string{}, false});
+      st_->notices.push_back(to_string(st_->jobs.back()));
+    }
+    // The job keeps the state alive, since it may outlive this object.
+    auto st = st_;
+    pool->submit([=]
+    {
+      std::string err;
+      std::string out;
+      command_result res;
+      {
+        string_writer buf{out};
+        std::ostream os{&buf};
+        io_redirect redirect{&os, nullptr};
+        res = f(err);
+      }
+      {
+        std::unique_lock<std::mutex> guard{st->mtx};
+        auto i = find(st->jobs, id);
+        if (i != st->jobs.end())
+        {
+          i->state = res == no_command ? job_failed : job_done;
+          i->result = res;
+          i->error = std::move(err);
+          i->output = std::move(out);
+        }
+      }
+      st->cv.notify_all();
+      std::unique_lock<std::mutex> guard{st->finish_mtx};
+      if (st->on_finish)
+        st->on_finish();
+    });
+    return id;
+  }
+
+  /// Returns a snapshot of the job table.
+  std::vector<job_info> jobs() const
+  {
+    std::unique_lock<std::mutex> guard{st_->mtx};
+    return st_->jobs;
+  }
+
+  /// Blocks until a job has finished and removes it from the job table.
+  /// @param id The ID of the job or 0 for the most recent job.
+  /// @param result Stores the state of the finished job, including its
+  ///               output unless already reported.
+  /// @param token Stops waiting once cancellation was requested, in which
+  ///              case the job keeps running in the background.
+  /// @returns `false` if no such job exists or if @p token was cancelled.
+  bool wait(size_t id, job_info& result,
+            cancellation_token const& token = cancellation_token{})
+  {
+    auto& jobs = st_->jobs;
+    std::unique_lock<std::mutex> guard{st_->mtx};
+    if (id == 0)
+    {
+      if (jobs.empty())
+        return false;
+      id = jobs.back().id;
+    }
+    auto i = find(jobs, id);
+    if (i == jobs.end())
+      return false;
+    auto finished = [&]
+    {
+      i = find(jobs, id);
+      return i == jobs.end() || i->state != job_running;
+    };
+    // Signal handlers cannot notify the condition variable, hence we
+    // check the token in short intervals.
+    while (! st_->cv.wait_for(guard, std::chrono::milliseconds(10), finished))
+      if (token.cancelled())
+        return false;
+    if (i == jobs.end())
+      return false; // somebody else collected the job
+    result = std::move(*i);
+    jobs.erase(i);
+    return true;
+  }
+
+  /// Passes a human-readable line to @p f for each job that started or
+  /// finished since the last call. The line for a finished job follows
+  /// its output, if any, without the final newline.
+  template<class F>
+  void drain_notices(F f)
+  {
+    std::vector<std::string> xs;
+    {
+      auto& jobs = st_->jobs;
+      std::unique_lock<std::mutex> guard{st_->mtx};
+      xs.swap(st_->notices);
+      size_t reported = 0;
+      for (auto& x : jobs)
+      {
+        if (x.state == job_running)
+          continue;
+        if (! x.reported)
+        {
+          if (! x.output.empty() && x.output.back() == '\n')
+            x.output.pop_back();
+          if (! x.output.empty())
+            xs.push_back(std::move(x.output));
+          x.output.clear();
+          xs.push_back(to_string(x));
+          x.reported = true;
+        }
+        ++reported;
+      }
+      // Drop the oldest reported jobs, which precede newer ones.
+      for (auto i = jobs.begin();
+           reported > max_finished && i != jobs.end();)
+      {
+        if (i->reported)
+        {
+          i = jobs.erase(i);
+          --reported;
+        }
+        else
+        {
+          ++i;
+        }
+      }
+    }
+    for (auto& x : xs)
+      f(const_cast<std::string const&>(x));
+  }
+
+  /// Renders a job in the format `[id] state  line`.
+  static std::string to_string(job_info const& x)
+  {
+    std::string result = "[";
+    result += std::to_string(x.id);
+    switch (x.state)
+    {
+      case job_running:
+        result += "] running  ";
+        break;
+      case job_done:
+        result += "] done     ";
+        break;
+      case job_failed:
+        result += "] failed   ";
+        break;
+    }
+    result += x.line;
+    if (! x.error.empty())
+    {
+      result += ": ";
+      result += x.error;
+    }
+    return result;
+  }
+
+private:
+  // The state shared with running jobs.
+  struct state
+  {
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::vector<job_info> jobs;
+    std::vector<std::string> notices;
+    // Serializes calls to `on_finish` with replacing it.
+    std::mutex finish_mtx;
+    std::function<void ()> on_finish;
+  };
+
+  static std::vector<job_info>::iterator find(std::vector<job_info>& xs,
+                                              size_t id)
+  {
+    return std::find_if(xs.begin(), xs.end(),
+                        [=](job_info const& x) { return x.id == id; });
+  }
+
+  size_t num_workers_;
+  size_t next_id_;
+  std::shared_ptr<state> st_;
+  // Declared last, so that our own workers terminate first.
+  std::shared_ptr<worker_pool> pool_;
+};
+
+constexpr size_t job_control::max_finished;
+
+} // namespace sash
+
+#endif // SASH_JOB_CONTROL_HPP
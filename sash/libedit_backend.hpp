@@ -19,18 +19,37 @@
 #ifndef SASH_BACKEND_HPP
 #define SASH_BACKEND_HPP
 
+#include <chrono>
+#include <memory>
 #include <string>
+#include <cctype>
 #include <cassert>
+#include <algorithm>
+
+#include <unistd.h>
+#include <sys/ioctl.h>
 
 #include <histedit.h>
 
 #include "sash/color.hpp"
+#include "sash/style.hpp"
+#include "sash/tracing.hpp"
+#include "sash/output_queue.hpp"
+#include "sash/dynamic_prompt.hpp"
+#include "sash/history_index.hpp"
+#include "sash/shared_history.hpp"
 
 namespace sash {
 
 /// The default backend wraps command line editing functionality
-/// as provided by `libedit`.
-template<class Completer>
+/// as provided by `libedit`. Constructing a backend is cheap: the `EditLine`
+/// instance is created on first use and then shared by all backends of the
+/// same type, while each backend keeps its own prompt, completer and history.
+/// The history, in turn, is initialized and loaded on first use. Hence, a
+/// shell can define many modes and only pays for the ones actually entered.
+/// @tparam Tracer A tracing policy for history operations, see
+///                {@link null_tracer}.
+template<class Completer, class Tracer = null_tracer>
 class libedit_backend
 {
 public:
@@ -39,116 +58,60 @@ public:
 
   using completer_type = Completer;
 
+  /// Latency statistics for rendering autosuggestions.
+  struct autosuggestion_stats
+  {
+    /// Number of keystrokes that triggered a lookup.
+    size_t lookups;
+    /// Accumulated time for lookups and rendering.
+    std::chrono::nanoseconds total;
+    /// Maximum time for a single lookup and rendering.
+    std::chrono::nanoseconds max;
+  };
+
+  /// Constructs a backend.
+  /// @param shell_name The program name for `editrc` lookups. Only the
+  ///                   backend that creates the shared `EditLine` instance
+  ///                   sets the name, i.e., the first one in use.
+  /// @param editrc The configuration file, see {@link source}. Like
+  ///               *shell_name*, only used by the first backend in use.
   libedit_backend(const char* shell_name,
                   std::string history_filename = "",
                   int history_size = 1000,
                   bool unique_history = true,
                   std::string completion_key = "\t",
                   char const* editrc = nullptr)
-   : history_filename_{std::move(history_filename)},
+   : hist_{nullptr},
+     history_filename_{std::move(history_filename)},
+     history_size_{history_size},
+     unique_history_{unique_history},
+     shell_name_{shell_name},
+     editrc_{editrc != nullptr ? editrc : ""},
+     comp_key_{std::move(completion_key)},
      completer_{std::make_shared<Completer>()},
-     eof_{false}
-  {
-    el_ = ::el_init(shell_name, stdin, stdout, stderr);
-    assert(el_ != nullptr);
-    // Make ourselves available in callbacks.
-    set(EL_CLIENTDATA, this);
-    // Keyboard defaults.
-    set(EL_EDITOR, "emacs");
-    // Setup completion.
-    using completion_handler = unsigned char (*)(EditLine*, int);
-    completion_handler ch_callback = [](EditLine* el, int) -> unsigned char
-    {
-      libedit_backend* self = nullptr;
-      ::el_get(el, EL_CLIENTDATA, &self);
-      assert(self != nullptr);
-      assert(self->el_ == el);
-      std::string line;
-      self->get_cursor_line(line);
-      std::string completed_line;
-      if (self->completer_->complete(completed_line, line) != completed)
-        return CC_REFRESH_BEEP;
-      self->insert(completed_line);
-      return CC_REDISPLAY;
-    };
-    set(EL_ADDFN, "sash-complete", "SASH complete", ch_callback);
-    set(EL_BIND, completion_key.c_str(), "sash-complete", NULL);
-    // FIXME: this is a fix for folks that have "bind -v" in their .editrc.
-    // Most of these also have "bind ^I rl_complete" in there to re-enable tab
-    // completion, which "bind -v" somehow disabled. A better solution to
-    // handle this problem would be desirable.
-    set(EL_ADDFN, "rl_complete", "default complete", ch_callback);
-    // Let all character reads go through our custom handler so that we can
-    // figure out when we receive EOF.
-    using char_read_handler = int (*)(EditLine*, char*);
-    char_read_handler cr_callback = [](EditLine* el, char* result) -> int
-    {
-      libedit_backend* self = nullptr;
-      ::el_get(el, EL_CLIENTDATA, &self);
-      assert(self != nullptr);
-      assert(self->el_ == el);
-      FILE* input_file_handle = nullptr;
-      ::el_get(el, EL_GETFP, 0, &input_file_handle);
-      auto empty_line = [el]() -> bool
-      {
-        auto info = ::el_line(el);
-        return info->buffer == info->cursor && info->buffer == info->lastchar;
-      };
-      for (;;)
-      {
-        errno = 0;
-        auto ch = static_cast<char>(::fgetc(input_file_handle));
-        if (ch == '\x04' && empty_line())
-        {
-          errno = 0;
-          ch = EOF;
-        }
-        if (ch == EOF)
-        {
-          if (errno == EINTR)
-          {
-            continue;
-          }
-          else
-          {
-            self->eof_ = true;
-            return 0;
-          }
-        }
-        else
-        {
-          *result = ch;
-          return 1;
-        }
-      }
-    };
-    set(EL_GETCFN, cr_callback);
-    // Setup for our prompt.
-    using prompt_function = char* (*)(EditLine* el);
-    prompt_function pf = [](EditLine* el) -> char*
-    {
-      libedit_backend* self;
-      ::el_get(el, EL_CLIENTDATA, &self);
-      assert(self);
-      return const_cast<char*>(self->prompt_.c_str());
-    };
-    set(EL_PROMPT, pf);
-    // Setup for our history.
-    hist_ = ::history_init();
-    assert(hist_ != nullptr);
-    set(EL_HIST, ::history, hist_);
-    minitrue(H_SETSIZE, history_size);
-    minitrue(H_SETUNIQUE, unique_history ? 1 : 0);
-    history_load();
-    // Source the editrc config.
-    source(editrc);
+     autosuggest_{false},
+     forwarding_{false},
+     suggestion_shown_{false},
+     suggestion_color_{color::none},
+     suggestion_stats_{0, std::chrono::nanoseconds{0},
+                       std::chrono::nanoseconds{0}}
+  {
+    // nop
   }
 
   ~libedit_backend()
   {
-    history_save();
-    ::history_end(hist_);
-    ::el_end(el_);
+    if (editor_ && editor_->owner == this)
+    {
+      ::el_set(editor_->el, EL_CLIENTDATA, static_cast<void*>(nullptr));
+      ::el_set(editor_->el, EL_HIST, ::history, static_cast<void*>(nullptr));
+      editor_->owner = nullptr;
+    }
+    if (hist_ != nullptr)
+    {
+      history_save();
+      ::history_end(hist_);
+    }
   }
 
   /// Parses an editrc.
@@ -157,34 +120,84 @@ public:
   /// @returns `true` on successful parsing.
   bool source(char const* editrc = nullptr)
   {
-    return ::el_source(el_, editrc) != -1;
+    return ::el_source(el(), editrc) != -1;
   }
 
   /// Resets the TTY and the parser.
   void reset()
   {
-    ::el_reset(el_);
+    ::el_reset(el());
   }
 
-  /// Writes the history to file.
+  /// Writes the history to file. This is a nop in shared history mode,
+  /// because entries are appended to the file as they are entered.
   void history_save()
   {
-    if (! history_filename_.empty())
+    typename Tracer::span span{"history save"};
+    if (! history_filename_.empty() && ! shared_history_)
       minitrue(H_SAVE, history_filename_.c_str());
   }
 
   /// Reads the history from file.
   void history_load()
   {
-    if (! history_filename_.empty())
+    if (shared_history_)
+      history_sync();
+    else if (! history_filename_.empty())
       minitrue(H_LOAD, history_filename_.c_str());
+    if (autosuggest_)
+      rebuild_index();
+  }
+
+  /// Switches to shared history mode, allowing any number of concurrent
+  /// sessions to use the same history file. In this mode, each call to
+  /// {@link history_enter} appends a single line to the file under an
+  /// exclusive lock and each call to {@link read_line} merges entries of
+  /// other sessions incrementally. In unique mode, consecutive duplicates
+  /// are dropped across sessions, like libedit's `H_SETUNIQUE` does within
+  /// one session. Note that the file format differs from libedit's `H_SAVE`
+  /// format and that only entries added via {@link history_enter} are
+  /// shared.
+  /// @returns `true` if the history file could be opened.
+  bool share_history()
+  {
+    if (history_filename_.empty())
+      return false;
+    std::unique_ptr<shared_history> ptr{
+      new shared_history(history_filename_, unique_history_)};
+    if (! ptr->valid())
+      return false;
+    shared_history_.swap(ptr);
+    // An uninitialized history picks up the shared file on first use.
+    if (hist_ != nullptr)
+    {
+      minitrue(H_SETUNIQUE, 0);
+      minitrue(H_CLEAR);
+      index_.clear();
+      history_sync();
+    }
+    return true;
+  }
+
+  /// Merges entries appended by other sessions into the local history.
+  void history_sync()
+  {
+    if (shared_history_)
+      shared_history_->merge([&](std::string const& entry)
+      {
+        minitrue(H_ENTER, entry.c_str());
+        index_add(entry);
+      });
   }
 
   /// Appends @p str to the current element of the history, or
   /// behave like {@link enter_history} if there is no current element.
   void history_add(std::string const& str)
   {
+    typename Tracer::span span{"history add"};
     minitrue(H_ADD, str.c_str());
+    if (autosuggest_ && minitrue(H_CURR) != -1)
+      index_add(hist_event_.str);
     history_save();
   }
 
@@ -197,49 +210,117 @@ public:
   /// Adds @p str as a new element to the history.
   void history_enter(std::string const& str)
   {
-    minitrue(H_ENTER, str.c_str());
+    typename Tracer::span span{"history enter"};
+    if (! shared_history_)
+    {
+      minitrue(H_ENTER, str.c_str());
+      index_add(str);
+      return;
+    }
+    auto enter = [&](std::string const& entry)
+    {
+      minitrue(H_ENTER, entry.c_str());
+      index_add(entry);
+    };
+    // Enter the line locally even if writing it failed, unless it repeats
+    // the last entry, which then is the newest local entry already.
+    if (shared_history_->append(str, enter) || shared_history_->last() != str)
+      enter(str);
+  }
+
+  /// Enables fish-style autosuggestions. While the cursor is at the end of
+  /// the line, the shell shows the remainder of the most recent history
+  /// entry starting with the current line in @p suggestion_color. Pressing
+  /// @p accept_key inserts the suggestion. Without a suggestion, the key
+  /// moves the cursor one character to the right. Suggestions come from a
+  /// prefix index, i.e., the cost per keystroke depends on the line length
+  /// but not on the size of the history.
+  /// @param accept_key The key binding for accepting a suggestion in
+  ///                   `bind` notation, e.g., `^F`.
+  /// @param suggestion_color The color for rendering suggestions.
+  void enable_autosuggestions(std::string const& accept_key = "^F",
+                              color::type suggestion_color = color::grey)
+  {
+    autosuggest_ = true;
+    suggestion_color_ = suggestion_color;
+    rebuild_index();
+    using accept_handler = unsigned char (*)(EditLine*, int);
+    accept_handler ah_callback = [](EditLine* el, int) -> unsigned char
+    {
+      libedit_backend* self = nullptr;
+      ::el_get(el, EL_CLIENTDATA, &self);
+      assert(self != nullptr);
+      if (! self->suggestion_.empty())
+      {
+        self->insert(self->suggestion_);
+        self->suggestion_.clear();
+        return CC_REFRESH;
+      }
+      // Guards against infinite recursion if *accept_key* is bound to the
+      // right arrow key itself.
+      if (self->forwarding_)
+        return CC_ERROR;
+      self->forwarding_ = true;
+      ::el_push(el, "\033[C");
+      return CC_NORM;
+    };
+    set(EL_ADDFN, "sash-accept-suggestion", "SASH accept suggestion",
+        ah_callback);
+    set(EL_BIND, accept_key.c_str(), "sash-accept-suggestion", NULL);
+  }
+
+  /// Returns latency statistics for autosuggestions.
+  autosuggestion_stats const& suggestion_stats() const
+  {
+    return suggestion_stats_;
+  }
+
+  /// Prints messages from @p queue above the prompt while reading a line.
+  /// With a queue, the backend reads input bytewise via `read(2)` instead of
+  /// stdio, i.e., the queue must be set before reading the first line.
+  void set_output_queue(std::shared_ptr<output_queue> queue)
+  {
+    queue_ = std::move(queue);
   }
 
   /// Sets a (colored) string as prompt for the shell.
   void set_prompt(std::string str, color::type strcolor = color::none)
   {
+    dynamic_prompt_.reset();
     prompt_.clear();
     add_to_prompt(std::move(str), strcolor);
   }
 
-  /// Appends a (colored) string to the prompt.
+  /// Sets a prompt that libedit renders on each redraw, i.e., changes of
+  /// its segments show up without waiting for the next line.
+  void set_prompt(std::shared_ptr<dynamic_prompt> ptr)
+  {
+    dynamic_prompt_ = std::move(ptr);
+  }
+
+  /// Appends a (colored) string to the static prompt. The color is
+  /// dropped unless `stdout` is a color terminal.
   void add_to_prompt(std::string str, color::type strcolor = color::none)
   {
-    if (str.empty())
-      return;
-    if (strcolor != color::none)
-    {
-      prompt_ += strcolor;
-      prompt_ += std::move(str);
-      prompt_ += color::reset;
-    }
-    else
-    {
-      prompt_ += std::move(str);
-    }
+    append_styled(prompt_, strcolor, str, terminal::colors(STDOUT_FILENO));
   }
 
   /// Returns the current prompt.
   std::string const& prompt() const
   {
-    return prompt_;
+    return dynamic_prompt_ ? dynamic_prompt_->render() : prompt_;
   }
 
   /// Checks whether we've reached the end of file.
   bool eof() const
   {
-    return eof_;
+    return editor_ && editor_->eof;
   }
 
   /// Reads a character.
   bool read_char(char& c)
   {
-    return ! eof() && get(&c) == 1;
+    return ! eof() && ::el_getc(el(), &c) == 1;
   }
 
   /// Reads a line.
@@ -248,9 +329,10 @@ public:
     if (eof())
       return false;
     line.clear();
-    raii_set guard{el_, EL_PREP_TERM};
+    history_sync();
+    raii_set guard{el(), EL_PREP_TERM};
     int n;
-    auto str = ::el_gets(el_, &n);
+    auto str = ::el_gets(el(), &n);
     if (n == -1 || eof())
       return false;
     if (str != nullptr)
@@ -264,7 +346,7 @@ public:
 
   void get_current_line(std::string& line)
   {
-    auto info = ::el_line(el_);
+    auto info = ::el_line(el());
     line.assign(
         info->buffer,
         static_cast<std::string::size_type>(info->lastchar - info->buffer));
@@ -272,7 +354,7 @@ public:
 
   void get_cursor_line(std::string& line)
   {
-    auto info = ::el_line(el_);
+    auto info = ::el_line(el());
     line.assign(
         info->buffer,
         static_cast<std::string::size_type>(info->cursor - info->buffer));
@@ -281,30 +363,30 @@ public:
   /// Returns the current cursor position.
   size_t cursor()
   {
-    auto info = ::el_line(el_);
+    auto info = ::el_line(el());
     return info->cursor - info->buffer;
   }
 
   /// Resizes the shell.
   void resize()
   {
-    ::el_resize(el_);
+    ::el_resize(el());
   }
 
   /// Rings a bell.
   void beep()
   {
-    ::el_beep(el_);
+    ::el_beep(el());
   }
 
   void push(char const* str)
   {
-    ::el_push(el_, str);
+    ::el_push(el(), str);
   }
 
   void insert(std::string const& str)
   {
-    ::el_insertstr(el_, str.c_str());
+    ::el_insertstr(el(), str.c_str());
   }
 
   completer_pointer get_completer()
@@ -316,21 +398,343 @@ private:
   // The Ministry of Truth. Its purpose is to
   // rewrite history over and over again...
   template<typename... Ts>
-  void minitrue(int flag, Ts... args)
+  int minitrue(int flag, Ts... args)
   {
-    ::history(hist_, &hist_event_, flag, args...);
+    return ::history(hist(), &hist_event_, flag, args...);
+  }
+
+  // EditLine state shared by all backends of this type. Only one backend at
+  // a time is bound to it, i.e., receives callbacks and provides the history.
+  struct editor
+  {
+    editor(char const* shell_name, char const* editrc)
+      : el{::el_init(shell_name, stdin, stdout, stderr)},
+        owner{nullptr},
+        eof{false}
+    {
+      assert(el != nullptr);
+      // Keyboard defaults.
+      ::el_set(el, EL_EDITOR, "emacs");
+      // Setup completion.
+      using completion_handler = unsigned char (*)(EditLine*, int);
+      completion_handler ch_callback = [](EditLine* el, int) -> unsigned char
+      {
+        libedit_backend* self = nullptr;
+        ::el_get(el, EL_CLIENTDATA, &self);
+        assert(self != nullptr);
+        assert(self->editor_->el == el);
+        std::string line;
+        self->get_cursor_line(line);
+        std::string completed_line;
+        if (self->completer_->complete(completed_line, line) != completed)
+          return CC_REFRESH_BEEP;
+        self->insert(completed_line);
+        return CC_REDISPLAY;
+      };
+      ::el_set(el, EL_ADDFN, "sash-complete", "SASH complete", ch_callback);
+      // FIXME: this is a fix for folks that have "bind -v" in their .editrc.
+      // Most of these also have "bind ^I rl_complete" in there to re-enable
+      // tab completion, which "bind -v" somehow disabled. A better solution
+      // to handle this problem would be desirable.
+      ::el_set(el, EL_ADDFN, "rl_complete", "default complete", ch_callback);
+      // Let all character reads go through our custom handler so that we can
+      // figure out when we receive EOF.
+      using char_read_handler = int (*)(EditLine*, char*);
+      char_read_handler cr_callback = [](EditLine* el, char* result) -> int
+      {
+        libedit_backend* self = nullptr;
+        ::el_get(el, EL_CLIENTDATA, &self);
+        assert(self != nullptr);
+        assert(self->editor_->el == el);
+        FILE* input_file_handle = nullptr;
+        ::el_get(el, EL_GETFP, 0, &input_file_handle);
+        auto empty_line = [el]() -> bool
+        {
+          auto info = ::el_line(el);
+          return info->buffer == info->cursor
+                 && info->buffer == info->lastchar;
+        };
+        self->show_suggestion();
+        for (;;)
+        {
+          errno = 0;
+          auto ch = static_cast<char>(self->queue_
+                                        ? self->read_queued(input_file_handle)
+                                        : ::fgetc(input_file_handle));
+          self->hide_suggestion();
+          if (ch == '\x04' && empty_line())
+          {
+            errno = 0;
+            ch = EOF;
+          }
+          if (ch == EOF)
+          {
+            if (errno == EINTR)
+            {
+              continue;
+            }
+            else
+            {
+              self->editor_->eof = true;
+              return 0;
+            }
+          }
+          else
+          {
+            *result = ch;
+            return 1;
+          }
+        }
+      };
+      ::el_set(el, EL_GETCFN, cr_callback);
+      // Setup for our prompt.
+      using prompt_function = char* (*)(EditLine* el);
+      prompt_function pf = [](EditLine* el) -> char*
+      {
+        libedit_backend* self;
+        ::el_get(el, EL_CLIENTDATA, &self);
+        assert(self);
+        return const_cast<char*>(self->prompt().c_str());
+      };
+      ::el_set(el, EL_PROMPT, pf);
+      // Source the editrc config.
+      ::el_source(el, editrc);
+    }
+
+    ~editor()
+    {
+      ::el_end(el);
+    }
+
+    EditLine* el;
+    libedit_backend* owner;
+    std::string completion_key;
+    bool eof;
+  };
+
+  static std::shared_ptr<editor> shared_editor(char const* shell_name,
+                                               char const* editrc)
+  {
+    static std::weak_ptr<editor> instance;
+    auto result = instance.lock();
+    if (! result)
+    {
+      result = std::make_shared<editor>(shell_name, editrc);
+      instance = result;
+    }
+    return result;
+  }
+
+  // Returns the shared EditLine instance after binding it to this backend.
+  EditLine* el()
+  {
+    if (! editor_)
+      editor_ = shared_editor(shell_name_.c_str(),
+                              editrc_.empty() ? nullptr : editrc_.c_str());
+    if (editor_->owner != this)
+    {
+      auto e = editor_->el;
+      editor_->owner = this;
+      ::el_set(e, EL_CLIENTDATA, static_cast<void*>(this));
+      ::el_set(e, EL_HIST, ::history, hist());
+      if (editor_->completion_key != comp_key_)
+      {
+        ::el_set(e, EL_BIND, comp_key_.c_str(), "sash-complete", NULL);
+        editor_->completion_key = comp_key_;
+      }
+    }
+    return editor_->el;
+  }
+
+  // Returns our history after initializing and loading it on first use.
+  History* hist()
+  {
+    if (hist_ == nullptr)
+    {
+      hist_ = ::history_init();
+      assert(hist_ != nullptr);
+      ::history(hist_, &hist_event_, H_SETSIZE, history_size_);
+      ::history(hist_, &hist_event_, H_SETUNIQUE,
+                unique_history_ && ! shared_history_ ? 1 : 0);
+      history_load();
+    }
+    return hist_;
+  }
+
+  void index_add(std::string const& entry)
+  {
+    if (! autosuggest_)
+      return;
+    // Keep the index from growing beyond what libedit still remembers.
+    if (index_.size() >= 2 * static_cast<size_t>(std::max(history_size_, 1)))
+      rebuild_index();
+    index_.add(entry);
+  }
+
+  void rebuild_index()
+  {
+    index_.clear();
+    // H_LAST is the oldest entry, H_PREV moves towards newer entries.
+    for (auto rc = minitrue(H_LAST); rc != -1; rc = minitrue(H_PREV))
+      index_.add(hist_event_.str);
+  }
+
+  // Renders the suggestion for the current line behind the cursor.
+  void show_suggestion()
+  {
+    forwarding_ = false;
+    suggestion_.clear();
+    if (! autosuggest_)
+      return;
+    auto start = std::chrono::steady_clock::now();
+    render_suggestion();
+    auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now() - start);
+    ++suggestion_stats_.lookups;
+    suggestion_stats_.total += elapsed;
+    suggestion_stats_.max = std::max(suggestion_stats_.max, elapsed);
+  }
+
+  void render_suggestion()
+  {
+    auto info = ::el_line(el());
+    if (info->cursor != info->lastchar)
+      return;
+    auto entry = index_.lookup(info->buffer, info->lastchar);
+    auto len = static_cast<size_t>(info->lastchar - info->buffer);
+    if (entry == nullptr || entry->size() <= len)
+      return;
+    suggestion_.assign(entry->begin() + static_cast<ptrdiff_t>(len),
+                       std::find(entry->begin(), entry->end(), '\n'));
+    FILE* out = nullptr;
+    get(EL_GETFP, 1, &out);
+    winsize ws;
+    if (suggestion_.empty() || out == nullptr
+        || ::ioctl(::fileno(out), TIOCGWINSZ, &ws) != 0 || ws.ws_col == 0)
+      return;
+    // Never draw past the right margin, since wrapping would confuse the
+    // redisplay logic of libedit.
+    auto column = (visible_prompt_width() + len) % ws.ws_col;
+    auto avail = ws.ws_col - column - 1;
+    auto n = std::min(avail, suggestion_.size());
+    if (n == 0)
+      return;
+    draw_buf_.clear();
+    if (suggestion_color_ != color::none)
+      draw_buf_ += suggestion_color_;
+    draw_buf_.append(suggestion_, 0, n);
+    if (suggestion_color_ != color::none)
+      draw_buf_ += color::reset;
+    draw_buf_ += "\033[";
+    draw_buf_ += std::to_string(n);
+    draw_buf_ += 'D';
+    ::fwrite(draw_buf_.data(), 1, draw_buf_.size(), out);
+    ::fflush(out);
+    suggestion_shown_ = true;
+  }
+
+  // Erases a rendered suggestion before libedit processes the next key.
+  void hide_suggestion()
+  {
+    if (! suggestion_shown_)
+      return;
+    suggestion_shown_ = false;
+    FILE* out = nullptr;
+    get(EL_GETFP, 1, &out);
+    if (out != nullptr)
+    {
+      ::fputs("\033[K", out);
+      ::fflush(out);
+    }
+  }
+
+  // Reads the next byte like `fgetc`, printing queued output while waiting.
+  // Bypasses stdio, since poll(2) cannot see bytes buffered in a FILE.
+  int read_queued(FILE* in)
+  {
+    auto fd = ::fileno(in);
+    while (! queue_->wait(fd))
+      print_queued();
+    unsigned char c;
+    return ::read(fd, &c, 1) == 1 ? c : EOF;
+  }
+
+  // Replaces prompt and line with the queued output and draws them again
+  // below. The cursor ends up where libedit expects it, i.e., libedit can
+  // continue to update the line incrementally.
+  void print_queued()
+  {
+    FILE* out = nullptr;
+    get(EL_GETFP, 1, &out);
+    if (out == nullptr)
+      return;
+    auto info = ::el_line(el());
+    auto pos = visible_prompt_width()
+               + static_cast<size_t>(info->cursor - info->buffer);
+    winsize ws;
+    if (::ioctl(::fileno(out), TIOCGWINSZ, &ws) == 0 && ws.ws_col > 0
+        && pos >= ws.ws_col)
+      draw_buf_ = "\033[" + std::to_string(pos / ws.ws_col) + "A\r\033[J";
+    else
+      draw_buf_ = "\r\033[J";
+    queue_->take(draw_buf_);
+    auto& str = prompt();
+    auto nl = str.rfind('\n');
+    draw_buf_.append(str, nl == std::string::npos ? 0 : nl + 1,
+                     std::string::npos);
+    // Save and restore the cursor, since the line may span multiple rows.
+    draw_buf_.append(info->buffer, info->cursor);
+    draw_buf_ += "\0337";
+    draw_buf_.append(info->cursor, info->lastchar);
+    draw_buf_ += "\0338";
+    ::fflush(out);
+    ::fwrite(draw_buf_.data(), 1, draw_buf_.size(), out);
+    ::fflush(out);
+    suggestion_shown_ = false;
+    show_suggestion();
+  }
+
+  // Computes the number of columns the prompt occupies in its last line.
+  size_t visible_prompt_width() const
+  {
+    if (dynamic_prompt_)
+    {
+      dynamic_prompt_->render();
+      return dynamic_prompt_->width();
+    }
+    size_t result = 0;
+    for (auto i = prompt_.begin(); i != prompt_.end(); ++i)
+    {
+      if (*i == '\n')
+      {
+        result = 0;
+      }
+      else if (*i == '\033')
+      {
+        // Skip escape sequences such as colors.
+        while (i + 1 != prompt_.end() && ! std::isalpha(*(i + 1)))
+          ++i;
+        if (i + 1 != prompt_.end())
+          ++i;
+      }
+      else
+      {
+        ++result;
+      }
+    }
+    return result;
   }
 
   template<typename... Ts>
   void get(int flag, Ts... args)
   {
-    ::el_get(el_, flag, args...);
+    ::el_get(el(), flag, args...);
   }
 
   template<typename... Ts>
   void set(int flag, Ts... args)
   {
-    ::el_set(el_, flag, args...);
+    ::el_set(el(), flag, args...);
   }
 
   // RAII enabling of editline settings.
@@ -352,14 +756,28 @@ private:
     int flag_;
   };
 
-  EditLine* el_;
+  std::shared_ptr<editor> editor_;
   History* hist_;
   HistEvent hist_event_;
   std::string history_filename_;
+  int history_size_;
+  bool unique_history_;
+  std::unique_ptr<shared_history> shared_history_;
+  std::string shell_name_;
+  std::string editrc_;
   std::string prompt_;
+  std::shared_ptr<dynamic_prompt> dynamic_prompt_;
   std::string comp_key_;
   completer_pointer completer_;
-  bool eof_;
+  std::shared_ptr<output_queue> queue_;
+  bool autosuggest_;
+  bool forwarding_;
+  bool suggestion_shown_;
+  color::type suggestion_color_;
+  history_index index_;
+  std::string suggestion_;
+  std::string draw_buf_;
+  autosuggestion_stats suggestion_stats_;
 };
 
 } // namespace sash
@@ -0,0 +1,201 @@
+/******************************************************************************
+ *                   ____     ______   ____     __  __                        *
+ *                  /\  _`\  /\  _  \ /\  _`\  /\ \/\ \                       *
+ *                  \ \,\L\_\\ \ \L\ \\ \,\L\_\\ \ \_\ \                      *
+ *                   \/_\__ \ \ \  __ \\/_\__ \ \ \  _  \                     *
+ *                     /\ \L\ \\ \ \/\ \ /\ \L\ \\ \ \ \ \                    *
+ *                     \ `\____\\ \_\ \_\\ `\____\\ \_\ \_\                   *
+ *                      \/_____/ \/_/\/_/ \/_____/ \/_/\/_/                   *
+ *                                                                            *
+ *                                                                            *
+ * Copyright (c) 2014                                                         *
+ * Matthias Vallentin <vallentin (at) icir.org>                               *
+ * Dominik Charousset <dominik.charousset (at) haw-hamburg.de>                *
+ *                                                                            *
+ * Distributed under the 3-clause BSD License.                                *
+ * See accompanying file LICENSE.                                             *
+\******************************************************************************/
+
+#ifndef SASH_LINE_PARSER_HPP
+#define SASH_LINE_PARSER_HPP
+
+#include <string>
+#include <vector>
+#include <cctype>
+#include <utility>
+#include <algorithm>
+
+namespace sash {
+
+/// Connects a segment of a command line to its predecessor.
+enum segment_connector
+{
+  /// The first segment or a segment following `;`.
+  always_run,
+  /// A segment following `&&`, runs only if its predecessor succeeded.
+  run_on_success,
+  /// A segment following `||`, runs only if its predecessor failed.
+  run_on_failure
+};
+
+/// Splits a command line in a single pass into segments separated by `;`,
+/// `&&` and `||`, each of which consists of one or more pipeline stages
+/// separated by `|`. Segments and stages are views into the parsed line
+/// with leading and trailing whitespace removed. Operators inside single or
+/// double quotes or after a backslash are literal text, like in
+/// `memo_cache::normalize`; stages keep the quotes and backslashes, i.e.,
+/// handlers receive the text as typed. The parser keeps its
+/// buffers between calls, i.e., parsing does not allocate once the
+/// buffers have grown to fit the longest line.
+class line_parser
+{
+public:
+  using iterator = std::string::const_iterator;
+
+  /// A `[first, last)` view into the parsed line.
+  using range = std::pair<iterator, iterator>;
+
+  /// A segment consists of `num_stages` stages, beginning at `first_stage`.
+  struct segment
+  {
+    segment_connector connector;
+    size_t first_stage;
+    size_t num_stages;
+  };
+
+  /// Parses `[first, last)`.
+  /// @returns `false` on a syntax error, in which case @p err describes
+  ///          the problem.
+  bool parse(std::string& err, iterator first, iterator last)
+  {
+    segments_.clear();
+    stages_.clear();
+    segments_.push_back(segment{always_run, 0, 0});
+    auto stage_begin = first;
+    auto i = first;
+    // Adds [stage_begin, i) as stage to the current segment.
+    auto add_stage = [&]() -> bool
+    {
+      auto x = std::find_if(stage_begin, i, not_space);
+      auto y = std::find_if(std::reverse_iterator<iterator>(i),
+                            std::reverse_iterator<iterator>(x),
+                            not_space).base();
+      if (x == y)
+        return false;
+      stages_.emplace_back(x, y);
+      ++segments_.back().num_stages;
+      return true;
+    };
+    auto fail = [&](char const* token) -> bool
+    {
+      err = "syntax error: missing command before '";
+      err += token;
+      err += "'";
+      return false;
+    };
+    // The open quote character or '\0'.
+    char quote = '\0';
+    for (; i != last; ++i)
+    {
+      auto next = i + 1;
+      if (*i == '\\' && quote != '\'' && next != last)
+      {
+        ++i; // skip the escaped character
+        continue;
+      }
+      if (quote != '\0')
+      {
+        if (*i == quote)
+          quote = '\0';
+        continue;
+      }
+      char const* token = nullptr;
+      segment_connector next_connector = always_run;
+      switch (*i)
+      {
+        case '"':
+        case '\'':
+          quote = *i;
+          continue;
+        case '|':
+          if (next != last && *next == '|')
+          {
+            token = "||";
+            next_connector = run_on_failure;
+            break;
+          }
+          if (! add_stage())
+            return fail("|");
+          stage_begin = next;
+          continue;
+        case '&':
+          if (next == last || *next != '&')
+            continue;
+          token = "&&";
+          next_connector = run_on_success;
+          break;
+        case ';':
+          token = ";";
+          break;
+        default:
+          continue;
+      }
+      if (! add_stage())
+        return fail(token);
+      if (next_connector != always_run)
+        ++i; // skip second character of && and ||
+      segments_.push_back(segment{next_connector, stages_.size(), 0});
+      stage_begin = i + 1;
+    }
+    if (! add_stage())
+    {
+      // Empty lines and a trailing ';' are fine, anything else is an error.
+      auto& back = segments_.back();
+      if (back.num_stages == 0 && back.connector == always_run)
+      {
+        segments_.pop_back();
+        return true;
+      }
+      err = "syntax error: missing command at end of line";
+      return false;
+    }
+    return true;
+  }
+
+  /// Returns the segments of the last parsed line.
+  std::vector<segment> const& segments() const
+  {
+    return segments_;
+  }
+
+  /// Returns the stages of the last parsed line.
+  std::vector<range> const& stages() const
+  {
+    return stages_;
+  }
+
+  /// Returns the begin of the stages of segment @p x.
+  std::vector<range>::const_iterator begin(segment const& x) const
+  {
+    return stages_.begin() + static_cast<ptrdiff_t>(x.first_stage);
+  }
+
+  /// Returns the end of the stages of segment @p x.
+  std::vector<range>::const_iterator end(segment const& x) const
+  {
+    return begin(x) + static_cast<ptrdiff_t>(x.num_stages);
+  }
+
+private:
+  static bool not_space(char c)
+  {
+    return ! isspace(c);
+  }
+
+  std::vector<segment> segments_;
+  std::vector<range> stages_;
+};
+
+} // namespace sash
+
+#endif // SASH_LINE_PARSER_HPP
@@ -0,0 +1,198 @@
+/******************************************************************************
+ *                   ____     ______   ____     __  __                        *
+ *                  /\  _`\  /\  _  \ /\  _`\  /\ \/\ \                       *
+ *                  \ \,\L\_\\ \ \L\ \\ \,\L\_\\ \ \_\ \                      *
+ *                   \/_\__ \ \ \  __ \\/_\__ \ \ \  _  \                     *
+ *                     /\ \L\ \\ \ \/\ \ /\ \L\ \\ \ \ \ \                    *
+ *                     \ `\____\\ \_\ \_\\ `\____\\ \_\ \_\                   *
+ *                      \/_____/ \/_/\/_/ \/_____/ \/_/\/_/                   *
+ *                                                                            *
+ *                                                                            *
+ * Copyright (c) 2014                                                         *
+ * Matthias Vallentin <vallentin (at) icir.org>                               *
+ * Dominik Charousset <dominik.charousset (at) haw-hamburg.de>                *
+ *                                                                            *
+ * Distributed under the 3-clause BSD License.                                *
+ * See accompanying file LICENSE.                                             *
+\******************************************************************************/
+
+#ifndef SASH_MEMO_CACHE_HPP
+#define SASH_MEMO_CACHE_HPP
+
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <cctype>
+#include <cstdint>
+
+namespace sash {
+
+/// Invalidates the cached results of all commands sharing this tag at once,
+/// e.g., a command changing the topology bumps the tag of all commands
+/// showing it. Copies of a tag refer to the same version counter.
+class cache_tag
+{
+public:
+  cache_tag() : version_{std::make_shared<std::atomic<uint64_t>>(0)}
+  {
+    // nop
+  }
+
+  /// Invalidates all results cached under this tag.
+  void bump()
+  {
+    version_->fetch_add(1, std::memory_order_release);
+  }
+
+  uint64_t version() const
+  {
+    return version_->load(std::memory_order_acquire);
+  }
+
+private:
+  std::shared_ptr<std::atomic<uint64_t>> version_;
+};
+
+/// Stores the output of a command per normalized argument string. Entries
+/// expire after a time-to-live or when their {@link cache_tag} is bumped.
+class memo_cache
+{
+  memo_cache(memo_cache const&) = delete;
+  memo_cache& operator=(memo_cache const&) = delete;
+
+public:
+  using clock = std::chrono::steady_clock;
+
+  /// @param ttl The lifetime of entries, or zero for entries that only
+  ///            expire when @p tag is bumped.
+  /// @param tag The tag for invalidating all entries.
+  /// @param max_entries The maximum number of cached argument strings.
+  memo_cache(clock::duration ttl, cache_tag tag, size_t max_entries = 64)
+    : ttl_{ttl},
+      tag_{std::move(tag)},
+      max_entries_{max_entries > 0 ? max_entries : 1}
+  {
+    // nop
+  }
+
+  /// Writes `[first, last)` to @p key with leading and trailing whitespace
+  /// removed and inner whitespace collapsed to single spaces. Whitespace
+  /// inside single or double quotes and after a backslash is kept as is.
+  template <class Iterator>
+  static void normalize(Iterator first, Iterator last, std::string& key)
+  {
+    key.clear();
+    bool space = false;
+    char quote = '\0';
+    for (; first != last; ++first)
+    {
+      auto c = *first;
+      if (quote == '\0' && isspace(static_cast<unsigned char>(c)))
+      {
+        space = ! key.empty();
+        continue;
+      }
+      if (space)
+        key += ' ';
+      space = false;
+      key += c;
+      if (c == '\\' && quote != '\'' && first + 1 != last)
+        key += *++first;
+      else if (c == quote)
+        quote = '\0';
+      else if (quote == '\0' && (c == '"' || c == '\''))
+        quote = c;
+    }
+  }
+
+  /// Copies the cached output for @p key into @p output.
+  /// @returns `false` if there is no valid entry for @p key.
+  bool lookup(std::string const& key, std::string& output)
+  {
+    auto version = tag_.version();
+    std::unique_lock<std::mutex> guard{mtx_};
+    auto i = entries_.find(key);
+    if (i == entries_.end())
+      return false;
+    if (i->second.version != version || expired(i->second, clock::now()))
+    {
+      entries_.erase(i);
+      return false;
+    }
+    output = i->second.output;
+    return true;
+  }
+
+  /// Caches @p output for @p key, where @p version is the version of the
+  /// tag before computing @p output.
+  void store(std::string key, std::string output, uint64_t version)
+  {
+    auto now = clock::now();
+    std::unique_lock<std::mutex> guard{mtx_};
+    if (entries_.size() >= max_entries_ && entries_.count(key) == 0)
+      evict(now);
+    auto& e = entries_[std::move(key)];
+    e.output = std::move(output);
+    e.version = version;
+    e.stored = now;
+  }
+
+  /// Returns the tag of this cache.
+  cache_tag const& tag() const
+  {
+    return tag_;
+  }
+
+  /// Drops all entries.
+  void clear()
+  {
+    std::unique_lock<std::mutex> guard{mtx_};
+    entries_.clear();
+  }
+
+private:
+  struct entry
+  {
+    std::string output;
+    uint64_t version;
+    clock::time_point stored;
+  };
+
+  bool expired(entry const& e, clock::time_point now) const
+  {
+    return ttl_ != clock::duration::zero() && now - e.stored >= ttl_;
+  }
+
+  // Drops invalid entries or, if all are valid, the oldest one.
+  void evict(clock::time_point now)
+  {
+    auto version = tag_.version();
+    for (auto i = entries_.begin(); i != entries_.end();)
+    {
+      if (i->second.version != version || expired(i->second, now))
+        i = entries_.erase(i);
+      else
+        ++i;
+    }
+    if (entries_.size() < max_entries_)
+      return;
+    auto oldest = entries_.begin();
+    for (auto i = entries_.begin(); i != entries_.end(); ++i)
+      if (i->second.stored < oldest->second.stored)
+        oldest = i;
+    entries_.erase(oldest);
+  }
+
+  clock::duration ttl_;
+  cache_tag tag_;
+  size_t max_entries_;
+  std::mutex mtx_;
+  std::map<std::string, entry> entries_;
+};
+
+} // namespace sash
+
+#endif // SASH_MEMO_CACHE_HPP
@@ -0,0 +1,194 @@
+/******************************************************************************
+ *                   ____     ______   ____     __  __                        *
+ *                  /\  _`\  /\  _  \ /\  _`\  /\ \/\ \                       *
+ *                  \ \,\L\_\\ \ \L\ \\ \,\L\_\\ \ \_\ \                      *
+ *                   \/_\__ \ \ \  __ \\/_\__ \ \ \  _  \                     *
+ *                     /\ \L\ \\ \ \/\ \ /\ \L\ \\ \ \ \ \                    *
+ *                     \ `\____\\ \_\ \_\\ `\____\\ \_\ \_\                   *
+ *                      \/_____/ \/_/\/_/ \/_____/ \/_/\/_/                   *
+ *                                                                            *
+ *                                                                            *
+ * Copyright (c) 2014                                                         *
+ * Matthias Vallentin <vallentin (at) icir.org>                               *
+ * Dominik Charousset <dominik.charousset (at) haw-hamburg.de>                *
+ *                                                                            *
+ * Distributed under the 3-clause BSD License.                                *
+ * See accompanying file LICENSE.                                             *
+\******************************************************************************/
+
+#ifndef SASH_MEMORY_BACKEND_HPP
+#define SASH_MEMORY_BACKEND_HPP
+
+#include <deque>
+#include <memory>
+#include <string>
+#include <cstring>
+
+#include "sash/color.hpp"
+
+namespace sash {
+
+/// A headless backend reading input from a caller-provided buffer instead
+/// of a terminal, e.g., for embedding a shell into a service or for tests
+/// and benchmarks. The backend never copies the input buffer, i.e., the
+/// buffer must outlive all reads. History is kept in memory only.
+template<class Completer>
+class memory_backend
+{
+public:
+  using completer_type = Completer;
+
+  using completer_pointer = std::shared_ptr<Completer>;
+
+  /// Constructs a memory backend. The history file and the completion key
+  /// exist for compatibility with the other backends and are ignored.
+  memory_backend(char const* = "sash",
+                 std::string = std::string{},
+                 int history_size = 1000,
+                 bool unique_history = true,
+                 std::string = std::string{})
+    : first_{nullptr},
+      last_{nullptr},
+      output_{nullptr},
+      history_size_{history_size > 0 ? static_cast<size_t>(history_size) : 0},
+      unique_history_{unique_history},
+      completer_{std::make_shared<Completer>()}
+  {
+    // nop
+  }
+
+  /// Sets the input to `[first, last)`.
+  void set_input(char const* first, char const* last)
+  {
+    first_ = first;
+    last_ = last;
+  }
+
+  /// Sets the input to @p str, which must outlive all reads.
+  void set_input(std::string const& str)
+  {
+    set_input(str.data(), str.data() + str.size());
+  }
+
+  /// Appends the prompt to @p out before each read, like a terminal would
+  /// display it, or disables the transcript if @p out is `nullptr`.
+  void set_output(std::string* out)
+  {
+    output_ = out;
+  }
+
+  void reset()
+  {
+    // nop
+  }
+
+  void history_save()
+  {
+    // nop
+  }
+
+  void history_load()
+  {
+    // nop
+  }
+
+  void history_add(std::string const& str)
+  {
+    if (history_size_ == 0
+        || (unique_history_ && ! history_.empty() && history_.back() == str))
+      return;
+    if (history_.size() == history_size_)
+      history_.pop_front();
+    history_.push_back(str);
+  }
+
+  void history_enter(std::string const& str)
+  {
+    history_add(str);
+  }
+
+  /// Returns the history, oldest entry first.
+  std::deque<std::string> const& history() const
+  {
+    return history_;
+  }
+
+  void set_prompt(std::string str, color::type c = color::none)
+  {
+    prompt_.clear();
+    add_to_prompt(std::move(str), c);
+  }
+
+  void add_to_prompt(std::string str, color::type c = color::none)
+  {
+    if (c == color::none)
+    {
+      prompt_ += str;
+    }
+    else
+    {
+      prompt_ += c;
+      prompt_ += str;
+      prompt_ += color::reset;
+    }
+  }
+
+  std::string const& prompt() const
+  {
+    return prompt_;
+  }
+
+  /// Checks whether all input has been consumed.
+  bool eof() const
+  {
+    return first_ == last_;
+  }
+
+  bool read_char(char& c)
+  {
+    if (eof())
+      return false;
+    c = *first_++;
+    return true;
+  }
+
+  /// Reads the next line without the trailing newline.
+  /// @returns `false` if all input has been consumed.
+  bool read_line(std::string& line)
+  {
+    if (eof())
+      return false;
+    if (output_ != nullptr)
+      *output_ += prompt_;
+    auto nl = static_cast<char const*>(
+      std::memchr(first_, '\n', static_cast<size_t>(last_ - first_)));
+    auto end = nl != nullptr ? nl : last_;
+    line.assign(first_, end);
+    if (output_ != nullptr)
+    {
+      output_->append(first_, end);
+      *output_ += '\n';
+    }
+    first_ = nl != nullptr ? nl + 1 : last_;
+    return true;
+  }
+
+  completer_pointer get_completer()
+  {
+    return completer_;
+  }
+
+private:
+  char const* first_;
+  char const* last_;
+  std::string* output_;
+  std::string prompt_;
+  size_t history_size_;
+  bool unique_history_;
+  std::deque<std::string> history_;
+  completer_pointer completer_;
+};
+
+} // namespace sash
+
+#endif // SASH_MEMORY_BACKEND_HPP
@@ -19,17 +19,30 @@
 #ifndef SASH_MODE_HPP
 #define SASH_MODE_HPP
 
+#include <set>
+#include <mutex>
 #include <tuple>
+#include <atomic>
 #include <memory>
 #include <string>
+#include <vector>
+#include <cstdint>
+#include <algorithm>
 
 #include "sash/color.hpp"
 #include "sash/command.hpp"
+#include "sash/tracing.hpp"
 
 namespace sash {
 
 /// A command-line context with its own commands, history, and prompt.
-template<class Backend, class Command>
+/// A mode can inherit the commands of a parent mode, which in turn can have
+/// a parent of its own. The commands of all modes in this chain are merged
+/// into a dispatch table that is cached per mode and rebuilt lazily whenever
+/// any mode in the chain changes. Commands of a mode shadow commands with
+/// the same name in its ancestors.
+/// @tparam Tracer A tracing policy, see {@link null_tracer}.
+template<class Backend, class Command, class Tracer = null_tracer>
 class mode
 {
   mode(mode const&) = delete;
@@ -48,6 +61,9 @@ public:
   /// A callback for commands.
   using command_cb = typename Command::callback_type;
 
+  /// A callback for commands that receives a cancellation token.
+  using cancellable_command_cb = typename Command::cancellable_callback_type;
+
   using mode_ptr = std::shared_ptr<mode>;
 
   /// Constructs a mode.
@@ -66,9 +82,16 @@ public:
     : backend_{shell_name, std::move(history_file),
           history_size, unique_history, completion_key},
       root_{std::make_shared<Command>(nullptr, backend_.get_completer(),
-                                      std::move(name), std::string{})}
+                                      std::move(name), std::string{})},
+      version_{0}
   {
     backend_.set_prompt(std::move(prompt), prompt_color);
+    auto source = [this](std::string const& line,
+                         std::vector<std::string>& matches)
+    {
+      complete(line, matches);
+    };
+    backend_.get_completer()->set_source(source);
   }
 
   /// Adds a sub-command to this mode.
@@ -94,6 +117,33 @@ public:
     return ptr;
   }
 
+  /// Adds a sub-command with cancellable handler to this mode.
+  /// @param name The name of the command.
+  /// @param desc A one-line description of the command.
+  /// @param func A functor to handle the new command.
+  /// @returns If successful, a valid pointer to the newly created command.
+  command_ptr add_cancellable(std::string name, std::string desc,
+                              typename Command::cancellable_callback_type func)
+  {
+    auto ptr = root_->add(std::move(name), std::move(desc));
+    if (ptr)
+      ptr->on_cancellable(std::move(func));
+    return ptr;
+  }
+
+  /// Adds a sub-command with typed arguments to this mode.
+  /// @param name The name of the command.
+  /// @param desc A one-line description of the command.
+  /// @param schema The arguments of the new command.
+  /// @param func A functor to handle the parsed arguments.
+  /// @returns If successful, a valid pointer to the newly created command.
+  command_ptr add(std::string name, std::string desc, argument_schema schema,
+                  typename Command::typed_callback_type func)
+  {
+    return root_->add(std::move(name), std::move(desc), std::move(schema),
+                      std::move(func));
+  }
+
   void add(std::vector<command_ptr> commands) {
     for (auto& cmd : commands)
       root_->add_copy(cmd);
@@ -106,16 +156,37 @@ public:
   // We work around this nonsene by a struct.
   struct cmd_clause
   {
+    cmd_clause(std::string name, std::string desc, command_cb f)
+      : cmd_name{std::move(name)},
+        cmd_desc{std::move(desc)},
+        cmd_fun{std::move(f)}
+    {
+      // nop
+    }
+
+    cmd_clause(std::string name, std::string desc, cancellable_command_cb f)
+      : cmd_name{std::move(name)},
+        cmd_desc{std::move(desc)},
+        cmd_cancellable_fun{std::move(f)}
+    {
+      // nop
+    }
+
     std::string cmd_name;
     std::string cmd_desc;
     command_cb  cmd_fun;
+    cancellable_command_cb cmd_cancellable_fun;
   };
 
   /// Adds all sub comands from @p clause to this mode.
   void add_all(std::vector<cmd_clause> clauses)
   {
     for (auto& clause : clauses)
-      add(clause.cmd_name, clause.cmd_desc, clause.cmd_fun);
+      if (clause.cmd_cancellable_fun)
+        add_cancellable(clause.cmd_name, clause.cmd_desc,
+                        clause.cmd_cancellable_fun);
+      else
+        add(clause.cmd_name, clause.cmd_desc, clause.cmd_fun);
   }
 
   /// Assigns a callback handler for unknown commands.
@@ -123,6 +194,7 @@ public:
   void on_unknown_command(command_cb f)
   {
     root_->on(std::move(f));
+    ++version_;
   }
 
   /// Assigns a callback handler for unknown commands.
@@ -149,12 +221,52 @@ public:
   /// Execute a command line.
   command_result execute(std::string& err, std::string const& line) const
   {
-    auto result = root_->execute(err, line);
-    if (result == command_result::no_command && parent_ != nullptr) {
-      err.clear();
-      result = parent_->root_->execute(err, line);
+    return execute(err, line, cancellation_token{});
+  }
+
+  /// Execute a command line that can be cancelled via @p token.
+  command_result execute(std::string& err, std::string const& line,
+                         cancellation_token const& token) const
+  {
+    return execute(err, line.begin(), line.end(), token);
+  }
+
+  /// Execute the command line `[first, last)` that can be cancelled
+  /// via @p token. The first word selects a command of this mode or of one
+  /// of its ancestors by name, by alias, or by a unique prefix. Unknown
+  /// commands go to the closest mode with a handler for unknown commands.
+  command_result execute(std::string& err,
+                         std::string::const_iterator first,
+                         std::string::const_iterator last,
+                         cancellation_token const& token) const
+  {
+    typename Tracer::span span{"mode", name()};
+    if (first == last)
+      return nop;
+    auto table = dispatch_table();
+    auto delim = std::find(first, last, ' ');
+    std::vector<std::string> candidates;
+    auto cmd = table->index.find(&*first, static_cast<size_t>(delim - first),
+                                 true, &candidates);
+    if (cmd != nullptr)
+      return (*cmd)->execute(err, delim == last ? last : delim + 1, last,
+                             token);
+    if (! candidates.empty())
+    {
+      Command::ambiguous(err, first, delim, candidates);
+      return no_command;
     }
-    return result;
+    for (auto m : table->chain)
+    {
+      if (m->root_->has_handler())
+      {
+        typename Tracer::span parent_span{"parent mode", m->name()};
+        return m->root_->execute(err, first, last, token);
+      }
+    }
+    err.assign(first, delim);
+    err += ": command not found";
+    return no_command;
   }
 
   /// Retrieves the name of this mode.
@@ -164,14 +276,62 @@ public:
     return root_->name();
   }
 
-  /// Retrieves the autogenerated help string for this mode.
+  /// Retrieves the autogenerated help string for this mode, including all
+  /// commands inherited from ancestors that are not shadowed.
   /// @param indent The number of spaces to indent the help text.
   /// @returns The help string for this mode.
   std::string help(size_t indent = 0) const
   {
-    if (! parent_)
-      return root_->help(indent);
-    return root_->help(indent) + parent_->root_->help(indent);
+    return Command::help_table(dispatch_table()->commands, indent);
+  }
+
+  /// Collects completion candidates for @p line by walking the commands
+  /// of this mode and its ancestors up to the word at the end of the line.
+  /// @param matches Receives @p line with the last word replaced by each
+  ///                candidate, followed by a space unless the candidate
+  ///                ends with a slash.
+  void complete(std::string const& line,
+                std::vector<std::string>& matches) const
+  {
+    auto table = dispatch_table();
+    auto last = line.end();
+    auto first = std::find_if(line.begin(), last,
+                              [](char c) { return c != ' '; });
+    auto delim = std::find(first, last, ' ');
+    std::vector<std::string> words;
+    if (delim == last)
+    {
+      auto len = static_cast<size_t>(last - first);
+      for (auto& cmd : table->commands)
+        if (len <= cmd->name().size() && std::equal(first, last,
+                                                    cmd->name().begin()))
+          words.push_back(cmd->name());
+    }
+    else if (first != last)
+    {
+      auto cmd = table->index.find(&*first,
+                                   static_cast<size_t>(delim - first), true);
+      if (cmd != nullptr)
+        (*cmd)->complete(delim + 1, last, words);
+    }
+    auto pos = line.rfind(' ');
+    auto keep = pos == std::string::npos ? 0 : pos + 1;
+    for (auto& word : words)
+    {
+      matches.emplace_back(line, 0, keep);
+      matches.back() += word;
+      // Directories are prefixes of further candidates, e.g., paths.
+      if (word.empty() || word.back() != '/')
+        matches.back() += ' ';
+    }
+  }
+
+  /// Rebuilds the cached dispatch table if any mode in the parent chain
+  /// changed. Called by the command line before reading input in this
+  /// mode, i.e., completion and the first command use a fresh table.
+  void refresh() const
+  {
+    dispatch_table();
   }
 
   /// Returns a reference to the CLI backend used by this mode.
@@ -194,8 +354,16 @@ public:
     return result;
   }
 
-  void parent(mode_ptr ptr) {
+  /// Sets the parent of this mode.
+  /// @returns `false` if @p ptr is this mode or one of its descendants,
+  ///          i.e., if the parent chain would contain a cycle.
+  bool parent(mode_ptr ptr) {
+    for (auto m = ptr.get(); m != nullptr; m = m->parent_.get())
+      if (m == this)
+        return false;
     parent_.swap(ptr);
+    ++version_;
+    return true;
   }
 
   const mode_ptr& parent() const {
@@ -208,6 +376,78 @@ public:
   }
 
 private:
+  // Identifies the state of one mode in the parent chain: the mode itself,
+  // its parent and unknown-command handlers, and the top-level commands and
+  // aliases of its root.
+  struct stamp
+  {
+    mode const* owner;
+    uint64_t version;
+    uint64_t root_version;
+
+    bool operator==(stamp const& other) const
+    {
+      return owner == other.owner && version == other.version
+             && root_version == other.root_version;
+    }
+  };
+
+  struct dispatch_cache
+  {
+    // One stamp per mode, starting with this mode.
+    std::vector<stamp> stamps;
+    // This mode followed by its ancestors.
+    std::vector<mode const*> chain;
+    // All visible top-level commands, own commands first.
+    std::vector<command_ptr> commands;
+    // Names and aliases of all top-level commands, where closer modes
+    // shadow their ancestors.
+    command_index<command_ptr> index;
+  };
+
+  stamp make_stamp() const
+  {
+    return {this, version_.load(), root_->version()};
+  }
+
+  bool is_valid(dispatch_cache const& table) const
+  {
+    size_t i = 0;
+    for (auto m = this; m != nullptr; m = m->parent_.get(), ++i)
+      if (i == table.stamps.size() || ! (table.stamps[i] == m->make_stamp()))
+        return false;
+    return i == table.stamps.size();
+  }
+
+  // Returns the cached dispatch table, rebuilding it if necessary. Modes are
+  // only modified from the thread owning the command line, but commands may
+  // execute concurrently on other threads, hence the atomic accessors.
+  std::shared_ptr<const dispatch_cache> dispatch_table() const
+  {
+    auto table = std::atomic_load(&cache_);
+    if (table && is_valid(*table))
+      return table;
+    std::unique_lock<std::mutex> guard{cache_mtx_};
+    table = std::atomic_load(&cache_);
+    if (table && is_valid(*table))
+      return table;
+    auto fresh = std::make_shared<dispatch_cache>();
+    std::set<std::string> names;
+    for (auto m = this; m != nullptr; m = m->parent_.get())
+    {
+      fresh->stamps.push_back(m->make_stamp());
+      fresh->chain.push_back(m);
+      for (auto& cmd : m->root_->children())
+        if (names.insert(cmd->name()).second)
+          fresh->commands.push_back(cmd);
+      for (auto& e : m->root_->index().entries())
+        fresh->index.add(e.key, e.cmd);
+    }
+    std::shared_ptr<const dispatch_cache> result = std::move(fresh);
+    std::atomic_store(&cache_, result);
+    return result;
+  }
+
   template <class F>
   static void foreach_command(F& fun, const command_ptr& cmd) {
     if (cmd->is_leaf())
@@ -230,6 +470,9 @@ private:
   Backend backend_;
   command_ptr root_;
   mode_ptr parent_;
+  std::atomic<uint64_t> version_;
+  mutable std::mutex cache_mtx_;
+  mutable std::shared_ptr<const dispatch_cache> cache_;
 };
 
 } // namespace sash
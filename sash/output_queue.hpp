@@ -0,0 +1,318 @@
+/******************************************************************************
+ *                   ____     ______   ____     __  __                        *
+ *                  /\  _`\  /\  _  \ /\  _`\  /\ \/\ \                       *
+ *                  \ \,\L\_\\ \ \L\ \\ \,\L\_\\ \ \_\ \                      *
+ *                   \/_\__ \ \ \  __ \\/_\__ \ \ \  _  \                     *
+ *                     /\ \L\ \\ \ \/\ \ /\ \L\ \\ \ \ \ \                    *
+ *                     \ `\____\\ \_\ \_\\ `\____\\ \_\ \_\                   *
+ *                      \/_____/ \/_/\/_/ \/_____/ \/_/\/_/                   *
+ *                                                                            *
+ *                                                                            *
+ * Copyright (c) 2014                                                         *
+ * Matthias Vallentin <vallentin (at) icir.org>                               *
+ * Dominik Charousset <dominik.charousset (at) haw-hamburg.de>                *
+ *                                                                            *
+ * Distributed under the 3-clause BSD License.                                *
+ * See accompanying file LICENSE.                                             *
+\******************************************************************************/
+
+#ifndef SASH_OUTPUT_QUEUE_HPP
+#define SASH_OUTPUT_QUEUE_HPP
+
+#include <map>
+#include <mutex>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace sash {
+
+/// Collects messages from background threads, e.g., alerts or job output,
+/// for printing above the prompt without corrupting the line being edited.
+/// Backends wait for input via {@link wait}, which returns whenever queued
+/// messages are due, and then print everything queued in a single redraw
+/// via {@link take}. Redraws happen at most once per frame, i.e., a burst
+/// of messages results in one redraw rather than one per message.
+///
+/// Each source has a token bucket limiting its message rate. Messages
+/// exceeding the limit or the capacity of the queue are dropped and counted
+/// per source; the next redraw then reports how many messages were lost.
+class output_queue
+{
+  output_queue(output_queue const&) = delete;
+  output_queue& operator=(output_queue const&) = delete;
+
+public:
+  using clock = std::chrono::steady_clock;
+
+  /// Constructs a queue.
+  /// @param frame The minimum time between two redraws.
+  /// @param capacity The maximum number of queued messages.
+  explicit output_queue(
+    std::chrono::milliseconds frame = std::chrono::milliseconds{50},
+    size_t capacity = 1024)
+    : frame_{frame},
+      capacity_{capacity},
+      last_frame_{clock::now() - frame},
+      frames_{0},
+      default_{0, 0}
+  {
+    if (::pipe(wake_) == 0)
+    {
+      for (auto fd : wake_)
+      {
+        ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+        ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+      }
+    }
+    else
+    {
+      wake_[0] = wake_[1] = -1;
+    }
+  }
+
+  ~output_queue()
+  {
+    for (auto fd : wake_)
+      if (fd != -1)
+        ::close(fd);
+  }
+
+  /// Limits @p source to @p per_second messages on average, allowing bursts
+  /// of up to @p burst messages. A rate of 0 removes the limit.
+  void rate_limit(std::string const& source, double per_second,
+                  size_t burst = 1)
+  {
+    std::unique_lock<std::mutex> guard{mtx_};
+    auto& s = sources_[source];
+    s.limit = bucket_limit{per_second, burst_of(burst)};
+    s.tokens = s.limit.burst;
+    s.last = clock::now();
+  }
+
+  /// Sets the limit for sources without an explicit {@link rate_limit}.
+  void default_rate_limit(double per_second, size_t burst = 1)
+  {
+    std::unique_lock<std::mutex> guard{mtx_};
+    default_ = bucket_limit{per_second, burst_of(burst)};
+  }
+
+  /// Enqueues @p message from @p source. Safe to call from any thread.
+  /// @returns `false` if the message was dropped.
+  bool post(std::string const& source, std::string message)
+  {
+    auto now = clock::now();
+    std::unique_lock<std::mutex> guard{mtx_};
+    auto i = sources_.find(source);
+    if (i == sources_.end())
+    {
+      i = sources_.emplace(source, source_state{}).first;
+      i->second.limit = default_;
+      i->second.tokens = default_.burst;
+      i->second.last = now;
+    }
+    auto& s = i->second;
+    auto idle = queue_.empty() && ! has_unreported();
+    auto admitted = s.admit(now) && queue_.size() < capacity_;
+    if (admitted)
+    {
+      queue_.push_back(std::move(message));
+    }
+    else
+    {
+      ++s.dropped;
+      ++s.unreported;
+    }
+    if (idle)
+      notify();
+    return admitted;
+  }
+
+  /// Returns a file descriptor that is readable while output is pending.
+  int fd() const
+  {
+    return wake_[0];
+  }
+
+  /// Blocks until @p fd becomes readable, queued output is due or a signal
+  /// interrupts the wait.
+  /// @returns `true` if @p fd is readable (or failed) or on a signal,
+  ///          `false` if the caller should print the queued output via
+  ///          {@link take}.
+  bool wait(int fd)
+  {
+    for (;;)
+    {
+      auto timeout = due_in();
+      if (timeout == 0)
+        return false;
+      // While output waits for the next frame, only the timeout matters.
+      pollfd fds[2] = {{fd, POLLIN, 0}, {wake_[0], POLLIN, 0}};
+      auto n = ::poll(fds, timeout < 0 && wake_[0] != -1 ? 2 : 1, timeout);
+      if (n < 0)
+        return true;
+      if (n > 0 && fds[0].revents != 0)
+        return true;
+    }
+  }
+
+  /// Appends all queued messages to @p out, each terminated by `"\r\n"`,
+  /// followed by a note per source that dropped messages since the last
+  /// call, and starts a new frame.
+  /// @returns The number of messages appended.
+  size_t take(std::string& out)
+  {
+    std::vector<std::string> xs;
+    std::unique_lock<std::mutex> guard{mtx_};
+    xs.swap(queue_);
+    last_frame_ = clock::now();
+    ++frames_;
+    char buf[64];
+    while (::read(wake_[0], buf, sizeof(buf)) > 0)
+      ; // drain
+    // The terminal is in raw mode, i.e., newlines need carriage returns.
+    for (auto& x : xs)
+    {
+      for (size_t j = 0; j < x.size(); ++j)
+      {
+        if (x[j] == '\n' && (j == 0 || x[j - 1] != '\r'))
+          out += '\r';
+        out += x[j];
+      }
+      if (x.empty() || x.back() != '\n')
+        out += "\r\n";
+    }
+    for (auto& kvp : sources_)
+    {
+      if (kvp.second.unreported == 0)
+        continue;
+      out += "[";
+      out += kvp.first;
+      out += ": ";
+      out += std::to_string(kvp.second.unreported);
+      out += kvp.second.unreported == 1 ? " message" : " messages";
+      out += " dropped]\r\n";
+      kvp.second.unreported = 0;
+    }
+    return xs.size();
+  }
+
+  /// Checks whether output is waiting for {@link take}.
+  bool pending() const
+  {
+    std::unique_lock<std::mutex> guard{mtx_};
+    return ! queue_.empty() || has_unreported();
+  }
+
+  /// Returns the number of messages dropped for @p source.
+  uint64_t dropped(std::string const& source) const
+  {
+    std::unique_lock<std::mutex> guard{mtx_};
+    auto i = sources_.find(source);
+    return i == sources_.end() ? 0 : i->second.dropped;
+  }
+
+  /// Returns the number of messages dropped for all sources.
+  uint64_t dropped() const
+  {
+    std::unique_lock<std::mutex> guard{mtx_};
+    uint64_t result = 0;
+    for (auto& kvp : sources_)
+      result += kvp.second.dropped;
+    return result;
+  }
+
+  /// Returns the number of redraws so far.
+  uint64_t frames() const
+  {
+    std::unique_lock<std::mutex> guard{mtx_};
+    return frames_;
+  }
+
+private:
+  struct bucket_limit
+  {
+    double rate;
+    double burst;
+  };
+
+  struct source_state
+  {
+    bucket_limit limit;
+    double tokens;
+    clock::time_point last;
+    uint64_t dropped = 0;
+    uint64_t unreported = 0;
+
+    // Refills the token bucket and takes a token if possible.
+    bool admit(clock::time_point now)
+    {
+      if (limit.rate <= 0)
+        return true;
+      std::chrono::duration<double> elapsed = now - last;
+      last = now;
+      tokens = std::min(limit.burst, tokens + elapsed.count() * limit.rate);
+      if (tokens < 1)
+        return false;
+      tokens -= 1;
+      return true;
+    }
+  };
+
+  static double burst_of(size_t n)
+  {
+    return static_cast<double>(std::max(n, size_t{1}));
+  }
+
+  bool has_unreported() const
+  {
+    for (auto& kvp : sources_)
+      if (kvp.second.unreported > 0)
+        return true;
+    return false;
+  }
+
+  // Wakes up a thread blocked in wait(), requires mtx_ to be locked.
+  void notify()
+  {
+    char c = 0;
+    if (::write(wake_[1], &c, 1) < 0)
+      return; // the pipe is full, i.e., a wakeup is pending anyway
+  }
+
+  // Returns the milliseconds until pending output is due, or -1 if there
+  // is none.
+  int due_in() const
+  {
+    std::unique_lock<std::mutex> guard{mtx_};
+    if (queue_.empty() && ! has_unreported())
+      return -1;
+    auto due = last_frame_ + frame_;
+    auto now = clock::now();
+    if (due <= now)
+      return 0;
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+      due - now).count();
+    return static_cast<int>(ms) + 1;
+  }
+
+  mutable std::mutex mtx_;
+  std::chrono::milliseconds frame_;
+  size_t capacity_;
+  clock::time_point last_frame_;
+  uint64_t frames_;
+  bucket_limit default_;
+  std::map<std::string, source_state> sources_;
+  std::vector<std::string> queue_;
+  int wake_[2];
+};
+
+} // namespace sash
+
+#endif // SASH_OUTPUT_QUEUE_HPP
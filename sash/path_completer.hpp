@@ -0,0 +1,402 @@
+/******************************************************************************
+ *                   ____     ______   ____     __  __                        *
+ *                  /\  _`\  /\  _  \ /\  _`\  /\ \/\ \                       *
+ *                  \ \,\L\_\\ \ \L\ \\ \,\L\_\\ \ \_\ \                      *
+ *                   \/_\__ \ \ \  __ \\/_\__ \ \ \  _  \                     *
+ *                     /\ \L\ \\ \ \/\ \ /\ \L\ \\ \ \ \ \                    *
+ *                     \ `\____\\ \_\ \_\\ `\____\\ \_\ \_\                   *
+ *                      \/_____/ \/_/\/_/ \/_____/ \/_/\/_/                   *
+ *                                                                            *
+ *                                                                            *
+ * Copyright (c) 2014                                                         *
+ * Matthias Vallentin <vallentin (at) icir.org>                               *
+ * Dominik Charousset <dominik.charousset (at) haw-hamburg.de>                *
+ *                                                                            *
+ * Distributed under the 3-clause BSD License.                                *
+ * See accompanying file LICENSE.                                             *
+\******************************************************************************/
+
+#ifndef SASH_PATH_COMPLETER_HPP
+#define SASH_PATH_COMPLETER_HPP
+
+#include <map>
+#include <mutex>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <climits>
+#include <iterator>
+#include <algorithm>
+
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+namespace sash {
+
+/// Completes file system paths, e.g., for the arguments of commands that
+/// load or export files. Directory listings are cached as sorted arrays,
+/// i.e., each completion selects the matching entries with a binary search
+/// instead of reading the directory again. On Linux, cached directories are
+/// watched via inotify and the listings are patched from the received
+/// events. Elsewhere, a listing is read again when the modification time of
+/// its directory changes.
+///
+/// Instances are cheap to copy and all copies share one cache, i.e., a
+/// completer can be passed to `command::on_complete_args` directly.
+/// Candidates for directories end with a slash.
+class path_completer
+{
+public:
+  /// An iterator to the command line input.
+  using const_iterator = std::string::const_iterator;
+
+  /// Constructs a path completer.
+  /// @param max_dirs The maximum number of cached directory listings.
+  explicit path_completer(size_t max_dirs = 64)
+    : state_{std::make_shared<state>(max_dirs)}
+  {
+    // nop
+  }
+
+  /// Returns the candidates for the last word in `[first, last)`.
+  std::vector<std::string> operator()(const_iterator first,
+                                      const_iterator last) const
+  {
+    auto word = std::find(std::reverse_iterator<const_iterator>(last),
+                          std::reverse_iterator<const_iterator>(first),
+                          ' ').base();
+    return complete(std::string(word, last));
+  }
+
+  /// Returns all paths starting with @p prefix. A leading `~/` refers to
+  /// the home directory. Hidden entries are candidates only if the last
+  /// component of @p prefix starts with a dot.
+  std::vector<std::string> complete(std::string const& prefix) const
+  {
+    std::vector<std::string> result;
+    auto slash = prefix.rfind('/');
+    auto dir = slash == std::string::npos ? std::string{}
+                                          : prefix.substr(0, slash + 1);
+    auto base = prefix.substr(dir.size());
+    auto path = resolve(dir);
+    if (path.empty())
+      return result;
+    std::unique_lock<std::mutex> guard{state_->mtx};
+    auto lst = state_->get(path);
+    if (lst == nullptr)
+      return result;
+    auto& names = lst->names;
+    auto i = std::lower_bound(names.begin(), names.end(), base);
+    for (; i != names.end() && i->compare(0, base.size(), base) == 0; ++i)
+      if ((*i)[0] != '.' || (! base.empty() && base[0] == '.'))
+        result.push_back(dir + *i);
+    return result;
+  }
+
+  /// Drops all cached listings.
+  void clear()
+  {
+    std::unique_lock<std::mutex> guard{state_->mtx};
+    state_->clear();
+  }
+
+  /// Returns the number of directory reads so far.
+  size_t num_reads() const
+  {
+    std::unique_lock<std::mutex> guard{state_->mtx};
+    return state_->reads;
+  }
+
+private:
+  // Returns the canonical path of the directory @p dir with a trailing
+  // slash, or an empty string on error. Canonical paths make sure that
+  // spellings like `""` and `"./"` share one listing.
+  static std::string resolve(std::string const& dir)
+  {
+    std::string result;
+    if (dir.compare(0, 2, "~/") == 0)
+    {
+      auto home = ::getenv("HOME");
+      if (home == nullptr)
+        return result;
+      result = home;
+      result += dir.substr(1);
+    }
+    else if (! dir.empty() && dir[0] == '/')
+    {
+      result = dir;
+    }
+    else
+    {
+      char buf[PATH_MAX];
+      if (::getcwd(buf, sizeof(buf)) == nullptr)
+        return result;
+      result = buf;
+      result += '/';
+      result += dir;
+    }
+    char buf[PATH_MAX];
+    if (::realpath(result.c_str(), buf) == nullptr)
+      return std::string{};
+    result = buf;
+    if (result.back() != '/')
+      result += '/';
+    return result;
+  }
+
+  struct listing
+  {
+    // Sorted entry names; directories end with a slash.
+    std::vector<std::string> names;
+    // The inotify watch descriptor or -1.
+    int wd;
+    // The modification time of the directory when not watched.
+    timespec mtime;
+    // Time of last use for eviction.
+    uint64_t used;
+
+    void insert(std::string name)
+    {
+      auto i = std::lower_bound(names.begin(), names.end(), name);
+      if (i == names.end() || *i != name)
+        names.insert(i, std::move(name));
+    }
+
+    void erase(std::string const& name)
+    {
+      auto i = std::lower_bound(names.begin(), names.end(), name);
+      if (i != names.end() && *i == name)
+        names.erase(i);
+    }
+  };
+
+  struct state
+  {
+    explicit state(size_t max) : max_dirs{max ? max : 1}, ticks{0}, reads{0}
+    {
+#ifdef __linux__
+      fd = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#else
+      fd = -1;
+#endif
+    }
+
+    ~state()
+    {
+      if (fd != -1)
+        ::close(fd);
+    }
+
+    // Returns the listing of @p path or `nullptr` if it is unreadable.
+    listing* get(std::string const& path)
+    {
+      drain();
+      auto i = listings.find(path);
+      if (i != listings.end() && (i->second.wd != -1 || unchanged(i)))
+      {
+        i->second.used = ++ticks;
+        return &i->second;
+      }
+      if (i != listings.end())
+        drop(i);
+      if (listings.size() >= max_dirs)
+        evict();
+      listing lst;
+      lst.wd = -1;
+      lst.mtime = timespec{0, 0};
+      lst.used = ++ticks;
+#ifdef __linux__
+      if (fd != -1)
+        lst.wd = ::inotify_add_watch(fd, path.c_str(),
+                                     IN_CREATE | IN_DELETE | IN_MOVED_FROM
+                                     | IN_MOVED_TO | IN_DELETE_SELF
+                                     | IN_MOVE_SELF | IN_ONLYDIR);
+#endif
+      // Reading after adding the watch does not miss any change, since
+      // events for entries we already have are no-ops.
+      if (! read_dir(path, lst))
+      {
+        if (watches.count(lst.wd) == 0)
+          unwatch(lst.wd);
+        return nullptr;
+      }
+      auto& result = listings[path];
+      result = std::move(lst);
+      if (result.wd != -1)
+        watches[result.wd].push_back(path);
+      return &result;
+    }
+
+    bool read_dir(std::string const& path, listing& lst)
+    {
+      auto d = ::opendir(path.c_str());
+      if (d == nullptr)
+        return false;
+      ++reads;
+      struct stat st;
+      if (::fstat(::dirfd(d), &st) == 0)
+        lst.mtime = mtime_of(st);
+      while (auto e = ::readdir(d))
+      {
+        std::string name = e->d_name;
+        if (name == "." || name == "..")
+          continue;
+        auto is_dir = e->d_type == DT_DIR;
+        if (e->d_type == DT_LNK || e->d_type == DT_UNKNOWN)
+          is_dir = ::fstatat(::dirfd(d), e->d_name, &st, 0) == 0
+                   && S_ISDIR(st.st_mode);
+        if (is_dir)
+          name += '/';
+        lst.names.push_back(std::move(name));
+      }
+      ::closedir(d);
+      std::sort(lst.names.begin(), lst.names.end());
+      return true;
+    }
+
+    bool unchanged(std::map<std::string, listing>::iterator i)
+    {
+      struct stat st;
+      if (::stat(i->first.c_str(), &st) != 0)
+        return false;
+      auto t = mtime_of(st);
+      return t.tv_sec == i->second.mtime.tv_sec
+             && t.tv_nsec == i->second.mtime.tv_nsec;
+    }
+
+    static timespec mtime_of(struct stat const& st)
+    {
+#ifdef __APPLE__
+      return st.st_mtimespec;
+#else
+      return st.st_mtim;
+#endif
+    }
+
+    // Applies all pending inotify events to the cached listings.
+    void drain()
+    {
+#ifdef __linux__
+      if (fd == -1)
+        return;
+      alignas(inotify_event) char buf[16 * 1024];
+      for (;;)
+      {
+        auto n = ::read(fd, buf, sizeof(buf));
+        if (n <= 0)
+          return;
+        for (char* ptr = buf; ptr < buf + n;)
+        {
+          auto ev = reinterpret_cast<inotify_event*>(ptr);
+          ptr += sizeof(inotify_event) + ev->len;
+          if (ev->mask & IN_Q_OVERFLOW)
+          {
+            clear();
+            continue;
+          }
+          auto w = watches.find(ev->wd);
+          if (w == watches.end())
+            continue;
+          // Dropping listings modifies the list of paths.
+          auto paths = w->second;
+          for (auto& path : paths)
+            apply(*ev, path);
+        }
+      }
+#endif
+    }
+
+#ifdef __linux__
+    // Applies @p ev to the listing of @p path.
+    void apply(inotify_event const& ev, std::string const& path)
+    {
+      auto i = listings.find(path);
+      if (i == listings.end())
+        return;
+      if (ev.mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED))
+      {
+        drop(i);
+        return;
+      }
+      std::string name = ev.len > 0 ? ev.name : "";
+      if (name.empty())
+        return;
+      if (ev.mask & IN_ISDIR)
+        name += '/';
+      if (ev.mask & (IN_CREATE | IN_MOVED_TO))
+        i->second.insert(std::move(name));
+      else if (ev.mask & (IN_DELETE | IN_MOVED_FROM))
+        i->second.erase(name);
+    }
+#endif
+
+    void unwatch(int wd)
+    {
+#ifdef __linux__
+      if (wd != -1)
+        ::inotify_rm_watch(fd, wd);
+#else
+      static_cast<void>(wd);
+#endif
+    }
+
+    // Removes a listing and its watch unless another listing, e.g., of a
+    // bind mount, shares the watch descriptor.
+    void drop(std::map<std::string, listing>::iterator i)
+    {
+      auto w = watches.find(i->second.wd);
+      if (w != watches.end())
+      {
+        auto& paths = w->second;
+        paths.erase(std::remove(paths.begin(), paths.end(), i->first),
+                    paths.end());
+        if (paths.empty())
+        {
+          unwatch(w->first);
+          watches.erase(w);
+        }
+      }
+      listings.erase(i);
+    }
+
+    void evict()
+    {
+      auto lru = listings.begin();
+      for (auto i = listings.begin(); i != listings.end(); ++i)
+        if (i->second.used < lru->second.used)
+          lru = i;
+      if (lru != listings.end())
+        drop(lru);
+    }
+
+    void clear()
+    {
+      while (! listings.empty())
+        drop(listings.begin());
+    }
+
+    int fd;
+    size_t max_dirs;
+    uint64_t ticks;
+    size_t reads;
+    std::mutex mtx;
+    std::map<std::string, listing> listings;
+    // Maps watch descriptors to all paths of the watched directory.
+    std::map<int, std::vector<std::string>> watches;
+  };
+
+  std::shared_ptr<state> state_;
+};
+
+} // namespace sash
+
+#endif // SASH_PATH_COMPLETER_HPP
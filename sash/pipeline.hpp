@@ -0,0 +1,261 @@
+/******************************************************************************
+ *                   ____     ______   ____     __  __                        *
+ *                  /\  _`\  /\  _  \ /\  _`\  /\ \/\ \                       *
+ *                  \ \,\L\_\\ \ \L\ \\ \,\L\_\\ \ \_\ \                      *
+ *                   \/_\__ \ \ \  __ \\/_\__ \ \ \  _  \                     *
+ *                     /\ \L\ \\ \ \/\ \ /\ \L\ \\ \ \ \ \                    *
+ *                     \ `\____\\ \_\ \_\\ `\____\\ \_\ \_\                   *
+ *                      \/_____/ \/_/\/_/ \/_____/ \/_/\/_/                   *
+ *                                                                            *
+ *                                                                            *
+ * Copyright (c) 2014                                                         *
+ * Matthias Vallentin <vallentin (at) icir.org>                               *
+ * Dominik Charousset <dominik.charousset (at) haw-hamburg.de>                *
+ *                                                                            *
+ * Distributed under the 3-clause BSD License.                                *
+ * See accompanying file LICENSE.                                             *
+\******************************************************************************/
+
+#ifndef SASH_PIPELINE_HPP
+#define SASH_PIPELINE_HPP
+
+#include <mutex>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstring>
+#include <utility>
+#include <istream>
+#include <iterator>
+#include <ostream>
+#include <iostream>
+#include <algorithm>
+#include <streambuf>
+#include <condition_variable>
+
+#include "sash/io.hpp"
+#include "sash/command.hpp"
+
+namespace sash {
+
+/// A FIFO byte buffer with fixed capacity connecting two pipeline stages.
+/// Writers block while the buffer is full and readers block while it is
+/// empty, i.e., large outputs stream through the pipe instead of being
+/// materialized in memory.
+class bounded_pipe
+{
+  bounded_pipe(bounded_pipe const&) = delete;
+  bounded_pipe& operator=(bounded_pipe const&) = delete;
+
+public:
+  explicit bounded_pipe(size_t capacity = 64 * 1024)
+    : buf_(capacity),
+      head_{0},
+      size_{0},
+      writer_closed_{false},
+      reader_closed_{false}
+  {
+    // nop
+  }
+
+  /// Writes @p n bytes, blocking while the pipe is full.
+  /// @returns `false` if the reading end has been closed.
+  bool write(char const* data, size_t n)
+  {
+    std::unique_lock<std::mutex> guard{mtx_};
+    while (n > 0)
+    {
+      cv_.wait(guard, [&] { return reader_closed_ || size_ < buf_.size(); });
+      if (reader_closed_)
+        return false;
+      auto tail = (head_ + size_) % buf_.size();
+      auto chunk = std::min(n, std::min(buf_.size() - size_,
+                                        buf_.size() - tail));
+      std::memcpy(buf_.data() + tail, data, chunk);
+      size_ += chunk;
+      data += chunk;
+      n -= chunk;
+      cv_.notify_all();
+    }
+    return true;
+  }
+
+  /// Reads up to @p n bytes, blocking while the pipe is empty.
+  /// @returns The number of bytes read or 0 at the end of the stream.
+  size_t read(char* data, size_t n)
+  {
+    std::unique_lock<std::mutex> guard{mtx_};
+    cv_.wait(guard, [&] { return writer_closed_ || size_ > 0; });
+    auto chunk = std::min(n, std::min(size_, buf_.size() - head_));
+    std::memcpy(data, buf_.data() + head_, chunk);
+    head_ = (head_ + chunk) % buf_.size();
+    size_ -= chunk;
+    cv_.notify_all();
+    return chunk;
+  }
+
+  /// Signals the end of the stream to the reader.
+  void close_write()
+  {
+    std::unique_lock<std::mutex> guard{mtx_};
+    writer_closed_ = true;
+    cv_.notify_all();
+  }
+
+  /// Signals to the writer that no more data is consumed.
+  void close_read()
+  {
+    std::unique_lock<std::mutex> guard{mtx_};
+    reader_closed_ = true;
+    cv_.notify_all();
+  }
+
+private:
+  std::mutex mtx_;
+  std::condition_variable cv_;
+  std::vector<char> buf_;
+  size_t head_;
+  size_t size_;
+  bool writer_closed_;
+  bool reader_closed_;
+};
+
+/// A stream buffer writing into a {@link bounded_pipe}.
+class pipe_writer : public std::streambuf
+{
+public:
+  explicit pipe_writer(bounded_pipe& pipe) : pipe_(pipe), buf_(4096)
+  {
+    setp(buf_.data(), buf_.data() + buf_.size());
+  }
+
+protected:
+  int_type overflow(int_type c) override
+  {
+    if (! flush_buf())
+      return traits_type::eof();
+    if (! traits_type::eq_int_type(c, traits_type::eof()))
+    {
+      *pptr() = traits_type::to_char_type(c);
+      pbump(1);
+    }
+    return traits_type::not_eof(c);
+  }
+
+  int sync() override
+  {
+    return flush_buf() ? 0 : -1;
+  }
+
+private:
+  bool flush_buf()
+  {
+    auto n = static_cast<size_t>(pptr() - pbase());
+    setp(buf_.data(), buf_.data() + buf_.size());
+    return n == 0 || pipe_.write(buf_.data(), n);
+  }
+
+  bounded_pipe& pipe_;
+  std::vector<char> buf_;
+};
+
+/// A stream buffer reading from a {@link bounded_pipe}.
+class pipe_reader : public std::streambuf
+{
+public:
+  explicit pipe_reader(bounded_pipe& pipe) : pipe_(pipe), buf_(4096)
+  {
+    setg(buf_.data(), buf_.data(), buf_.data());
+  }
+
+protected:
+  int_type underflow() override
+  {
+    auto n = pipe_.read(buf_.data(), buf_.size());
+    if (n == 0)
+      return traits_type::eof();
+    setg(buf_.data(), buf_.data(), buf_.data() + n);
+    return traits_type::to_int_type(*gptr());
+  }
+
+private:
+  bounded_pipe& pipe_;
+  std::vector<char> buf_;
+};
+
+/// Runs all stages of a pipeline concurrently, each stage except the last
+/// one on its own thread. The output of each stage is connected to the
+/// input of the next stage via a {@link bounded_pipe}. The first stage
+/// inherits the input and the last stage inherits the output of the
+/// calling thread.
+/// @param err Receives the error of the first failing stage.
+/// @param first Points to the first `[first, last)` pair of iterators.
+/// @param last Points past the last `[first, last)` pair of iterators.
+/// @param exec A functor with signature
+///             `command_result (std::string&, Iterator, Iterator)`.
+/// @returns `no_command` if any stage failed, otherwise the result of the
+///          last stage.
+template<class RangeIterator, class F>
+command_result run_pipeline(std::string& err, RangeIterator first,
+                            RangeIterator last, F exec)
+{
+  auto n = static_cast<size_t>(std::distance(first, last));
+  if (n == 0)
+    return nop;
+  std::vector<std::unique_ptr<bounded_pipe>> pipes;
+  for (size_t i = 1; i < n; ++i)
+    pipes.emplace_back(new bounded_pipe);
+  std::vector<std::string> errs(n);
+  std::vector<command_result> results(n, nop);
+  auto last_out = &output();
+  auto first_in = input();
+  auto run_stage = [&](size_t i)
+  {
+    std::unique_ptr<pipe_reader> rbuf;
+    std::unique_ptr<pipe_writer> wbuf;
+    std::unique_ptr<std::istream> is;
+    std::unique_ptr<std::ostream> os;
+    if (i > 0)
+    {
+      rbuf.reset(new pipe_reader(*pipes[i - 1]));
+      is.reset(new std::istream(rbuf.get()));
+    }
+    if (i + 1 < n)
+    {
+      wbuf.reset(new pipe_writer(*pipes[i]));
+      os.reset(new std::ostream(wbuf.get()));
+    }
+    {
+      io_redirect guard{os ? os.get() : last_out, is ? is.get() : first_in};
+      auto& stage = *(first + static_cast<ptrdiff_t>(i));
+      results[i] = exec(errs[i], stage.first, stage.second);
+    }
+    if (os)
+    {
+      os->flush();
+      pipes[i]->close_write();
+    }
+    if (i > 0)
+      pipes[i - 1]->close_read();
+  };
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i + 1 < n; ++i)
+    threads.emplace_back(run_stage, i);
+  run_stage(n - 1);
+  for (auto& t : threads)
+    t.join();
+  for (size_t i = 0; i < n; ++i)
+  {
+    if (results[i] == no_command)
+    {
+      err = std::move(errs[i]);
+      return no_command;
+    }
+  }
+  return results.back();
+}
+
+} // namespace sash
+
+#endif // SASH_PIPELINE_HPP
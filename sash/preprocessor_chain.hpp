@@ -0,0 +1,197 @@
+/******************************************************************************
+ *                   ____     ______   ____     __  __                        *
+ *                  /\  _`\  /\  _  \ /\  _`\  /\ \/\ \                       *
+ *                  \ \,\L\_\\ \ \L\ \\ \,\L\_\\ \ \_\ \                      *
+ *                   \/_\__ \ \ \  __ \\/_\__ \ \ \  _  \                     *
+ *                     /\ \L\ \\ \ \/\ \ /\ \L\ \\ \ \ \ \                    *
+ *                     \ `\____\\ \_\ \_\\ `\____\\ \_\ \_\                   *
+ *                      \/_____/ \/_/\/_/ \/_____/ \/_/\/_/                   *
+ *                                                                            *
+ *                                                                            *
+ * Copyright (c) 2014                                                         *
+ * Matthias Vallentin <vallentin (at) icir.org>                               *
+ * Dominik Charousset <dominik.charousset (at) haw-hamburg.de>                *
+ *                                                                            *
+ * Distributed under the 3-clause BSD License.                                *
+ * See accompanying file LICENSE.                                             *
+\******************************************************************************/
+
+#ifndef SASH_PREPROCESSOR_CHAIN_HPP
+#define SASH_PREPROCESSOR_CHAIN_HPP
+
+#include <tuple>
+#include <string>
+#include <utility>
+#include <type_traits>
+
+namespace sash {
+
+/// The result of a preprocessing stage. Stages report errors by setting the
+/// error string, in which case the result is ignored.
+enum preprocess_result
+{
+  /// The stage did not write any output, the next stage reads its input.
+  line_unchanged,
+  /// The stage wrote the processed line to its output.
+  line_changed,
+  /// The stage consumed the line, e.g., a variable assignment, and the
+  /// line must not be executed.
+  line_consumed
+};
+
+namespace detail {
+
+// Stages returning `void` follow the protocol of `std::function`-based
+// preprocessors: an empty output means the line was consumed.
+template<class F>
+auto invoke_stage(F& f, std::string& err, std::string const& in,
+                  std::string& out)
+-> typename std::enable_if<std::is_void<decltype(f(err, in, out))>::value,
+                           preprocess_result>::type
+{
+  f(err, in, out);
+  return out.empty() ? line_consumed : line_changed;
+}
+
+template<class F>
+auto invoke_stage(F& f, std::string& err, std::string const& in,
+                  std::string& out)
+-> typename std::enable_if<! std::is_void<decltype(f(err, in, out))>::value,
+                           preprocess_result>::type
+{
+  return f(err, in, out);
+}
+
+// Runs a single stage on `*line`, writing into whichever buffer does not
+// hold `*line`, and points `line` to the output if the stage changed it.
+template<class F>
+preprocess_result run_stage(F& f, std::string& err, std::string const*& line,
+                            std::string& buf1, std::string& buf2)
+{
+  auto& out = line == &buf1 ? buf2 : buf1;
+  out.clear();
+  auto result = invoke_stage(f, err, *line, out);
+  if (result == line_changed && err.empty())
+    line = &out;
+  return result;
+}
+
+template<class T>
+struct is_preprocessor_chain : std::false_type { };
+
+} // namespace detail
+
+/// A sequence of preprocessing stages resolved at compile time, i.e., the
+/// compiler can inline each stage instead of calling through a
+/// `std::function`. A stage is a functor with signature
+/// `preprocess_result (std::string& err, std::string const& in,
+/// std::string& out) const` or, for compatibility, `void (...) const` with
+/// the semantics of `std::function`-based preprocessors. The chain borrows the
+/// input line and ping-pongs between two caller-provided buffers, which
+/// stages reporting `line_unchanged` leave untouched.
+template<class... Stages>
+class preprocessor_chain
+{
+public:
+  preprocessor_chain() = default;
+
+  explicit preprocessor_chain(Stages... stages)
+    : stages_(std::move(stages)...)
+  {
+    // nop
+  }
+
+  /// Runs all stages on `*line`, stopping at the first error or at the
+  /// first stage that consumes the line.
+  /// @param err Receives the error message of the failing stage.
+  /// @param line Points to the input and, afterwards, to the output, i.e.,
+  ///             either the input itself or one of the buffers.
+  /// @param buf1 A scratch buffer.
+  /// @param buf2 Another scratch buffer.
+  /// @returns `line_unchanged` if no stage changed the line, `line_consumed`
+  ///          if a stage consumed it, and `line_changed` otherwise.
+  preprocess_result operator()(std::string& err, std::string const*& line,
+                               std::string& buf1, std::string& buf2) const
+  {
+    return run(err, line, buf1, buf2, line_unchanged,
+               std::integral_constant<size_t, 0>{});
+  }
+
+  /// Returns the stage at position `I`.
+  template<size_t I>
+  typename std::tuple_element<I, std::tuple<Stages...>>::type const&
+  stage() const
+  {
+    return std::get<I>(stages_);
+  }
+
+private:
+  preprocess_result run(std::string&, std::string const*&, std::string&,
+                        std::string&, preprocess_result result,
+                        std::integral_constant<size_t, sizeof...(Stages)>) const
+  {
+    return result;
+  }
+
+  template<size_t I>
+  preprocess_result run(std::string& err, std::string const*& line,
+                        std::string& buf1, std::string& buf2,
+                        preprocess_result result,
+                        std::integral_constant<size_t, I>) const
+  {
+    auto x = detail::run_stage(std::get<I>(stages_), err, line, buf1, buf2);
+    if (! err.empty() || x == line_consumed)
+      return line_consumed;
+    return run(err, line, buf1, buf2, x == line_changed ? x : result,
+               std::integral_constant<size_t, I + 1>{});
+  }
+
+  std::tuple<Stages...> stages_;
+};
+
+/// Creates a {@link preprocessor_chain} from a list of stages.
+template<class... Stages>
+preprocessor_chain<typename std::decay<Stages>::type...>
+make_preprocessor_chain(Stages&&... stages)
+{
+  return preprocessor_chain<typename std::decay<Stages>::type...>{
+    std::forward<Stages>(stages)...};
+}
+
+namespace detail {
+
+template<class... Stages>
+struct is_preprocessor_chain<preprocessor_chain<Stages...>> : std::true_type
+{
+};
+
+} // namespace detail
+
+/// Runs a preprocessor, which is either a single stage or a
+/// {@link preprocessor_chain}, on `*line`. See
+/// `preprocessor_chain::operator()` for the parameters.
+template<class Preprocessor>
+typename std::enable_if<detail::is_preprocessor_chain<
+                          typename std::remove_const<Preprocessor>::type
+                        >::value,
+                        preprocess_result>::type
+apply_preprocessor(Preprocessor& p, std::string& err, std::string const*& line,
+                   std::string& buf1, std::string& buf2)
+{
+  return p(err, line, buf1, buf2);
+}
+
+template<class Preprocessor>
+typename std::enable_if<! detail::is_preprocessor_chain<
+                          typename std::remove_const<Preprocessor>::type
+                        >::value,
+                        preprocess_result>::type
+apply_preprocessor(Preprocessor& p, std::string& err, std::string const*& line,
+                   std::string& buf1, std::string& buf2)
+{
+  return detail::run_stage(p, err, line, buf1, buf2);
+}
+
+} // namespace sash
+
+#endif // SASH_PREPROCESSOR_CHAIN_HPP
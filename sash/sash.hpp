@@ -26,7 +26,9 @@
 #include "sash/mode.hpp"
 #include "sash/color.hpp"
 #include "sash/command.hpp"
+#include "sash/tracing.hpp"
 #include "sash/completer.hpp"
+#include "sash/cancellation.hpp"
 #include "sash/command_line.hpp"
 
 /// The namespace of the SAne SHell wrapper.
@@ -41,17 +43,28 @@ using command_cb = std::function<command_result (std::string&,
                                                  std::string::const_iterator,
                                                  std::string::const_iterator)>;
 
+/// The default type for command callbacks that support cancellation.
+using cancellable_command_cb =
+  std::function<command_result (std::string&,
+                                std::string::const_iterator,
+                                std::string::const_iterator,
+                                cancellation_token const&)>;
+
 /// The default type for preprocessors.
 using preprocessor_fun = std::function<void (std::string&,
                                              const std::string&,
                                              std::string&)>;
 
 /// Utility class that fuses all types together and provides
-/// a typedef @p type for the actual CLI we want.
-template<template<class> class Backend,
+/// a typedef @p type for the actual CLI we want. The tracing policy applies
+/// to the command line, its modes and commands. Backends with a tracing
+/// policy, e.g., `libedit_backend<Completer, recording_tracer>`, can be
+/// passed via an alias template.
+template<template<class...> class Backend,
          class CompletionCallback = completion_cb,
          class CommandCallback = command_cb,
-         class Preprocessor = preprocessor_fun>
+         class Preprocessor = preprocessor_fun,
+         class Tracer = null_tracer>
 struct sash
 {
   /// The type of our completion context.
@@ -61,10 +74,10 @@ struct sash
   using backend_type = Backend<completer_type>;
 
   /// The type of a command.
-  using command_type = command<completer_type, command_cb>;
+  using command_type = command<completer_type, CommandCallback, Tracer>;
 
   /// The type of our CLI.
-  using type = command_line<backend_type, command_type, preprocessor_fun>;
+  using type = command_line<backend_type, command_type, Preprocessor, Tracer>;
 };
 
 } // namespace sash
@@ -0,0 +1,130 @@
+/******************************************************************************
+ *                   ____     ______   ____     __  __                        *
+ *                  /\  _`\  /\  _  \ /\  _`\  /\ \/\ \                       *
+ *                  \ \,\L\_\\ \ \L\ \\ \,\L\_\\ \ \_\ \                      *
+ *                   \/_\__ \ \ \  __ \\/_\__ \ \ \  _  \                     *
+ *                     /\ \L\ \\ \ \/\ \ /\ \L\ \\ \ \ \ \                    *
+ *                     \ `\____\\ \_\ \_\\ `\____\\ \_\ \_\                   *
+ *                      \/_____/ \/_/\/_/ \/_____/ \/_/\/_/                   *
+ *                                                                            *
+ *                                                                            *
+ * Copyright (c) 2014                                                         *
+ * Matthias Vallentin <vallentin (at) icir.org>                               *
+ * Dominik Charousset <dominik.charousset (at) haw-hamburg.de>                *
+ *                                                                            *
+ * Distributed under the 3-clause BSD License.                                *
+ * See accompanying file LICENSE.                                             *
+\******************************************************************************/
+
+#ifndef SASH_SESSION_BACKEND_HPP
+#define SASH_SESSION_BACKEND_HPP
+
+#include <memory>
+#include <string>
+
+#include "sash/color.hpp"
+
+namespace sash {
+
+/// A backend for sessions of a {@link session_server}. Sessions do not own
+/// a terminal: the server reads input lines from the socket and passes them
+/// to `command_line::process` directly. Hence, a session backend merely
+/// stores the prompt and the completer of a mode, both of which remain
+/// immutable once the mode is set up. This allows all sessions of a server
+/// to share the same modes, i.e., the same command trees and completers.
+/// Sessions keep no history.
+template<class Completer>
+class session_backend
+{
+public:
+  using completer_type = Completer;
+
+  using completer_pointer = std::shared_ptr<Completer>;
+
+  /// Constructs a session backend. Only the signature matches the
+  /// other backends, history settings and the completion key are ignored.
+  session_backend(char const* = "sash",
+                  std::string = std::string{},
+                  int = 1000,
+                  bool = true,
+                  std::string = std::string{})
+    : completer_{std::make_shared<Completer>()}
+  {
+    // nop
+  }
+
+  void reset()
+  {
+    // nop
+  }
+
+  void history_save()
+  {
+    // nop
+  }
+
+  void history_load()
+  {
+    // nop
+  }
+
+  void history_add(std::string const&)
+  {
+    // nop
+  }
+
+  void history_enter(std::string const&)
+  {
+    // nop
+  }
+
+  void set_prompt(std::string str, color::type c = color::none)
+  {
+    prompt_.clear();
+    add_to_prompt(std::move(str), c);
+  }
+
+  void add_to_prompt(std::string str, color::type c = color::none)
+  {
+    if (c == color::none)
+    {
+      prompt_ += str;
+    }
+    else
+    {
+      prompt_ += c;
+      prompt_ += str;
+      prompt_ += color::reset;
+    }
+  }
+
+  std::string const& prompt() const
+  {
+    return prompt_;
+  }
+
+  /// Always fails, since the {@link session_server} pushes input lines.
+  bool read_char(char&)
+  {
+    return false;
+  }
+
+  /// Always fails, since the {@link session_server} pushes input lines.
+  bool read_line(std::string&)
+  {
+    return false;
+  }
+
+  completer_pointer get_completer()
+  {
+    return completer_;
+  }
+
+private:
+  std::string prompt_;
+  completer_pointer completer_;
+};
+
+} // namespace sash
+
+#endif // SASH_SESSION_BACKEND_HPP
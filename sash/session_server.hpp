@@ -0,0 +1,506 @@
+/******************************************************************************
+ *                   ____     ______   ____     __  __                        *
+ *                  /\  _`\  /\  _  \ /\  _`\  /\ \/\ \                       *
+ *                  \ \,\L\_\\ \ \L\ \\ \,\L\_\\ \ \_\ \                      *
+ *                   \/_\__ \ \ \  __ \\/_\__ \ \ \  _  \                     *
+ *                     /\ \L\ \\ \ \/\ \ /\ \L\ \\ \ \ \ \                    *
+ *                     \ `\____\\ \_\ \_\\ `\____\\ \_\ \_\                   *
+ *                      \/_____/ \/_/\/_/ \/_____/ \/_/\/_/                   *
+ *                                                                            *
+ *                                                                            *
+ * Copyright (c) 2014                                                         *
+ * Matthias Vallentin <vallentin (at) icir.org>                               *
+ * Dominik Charousset <dominik.charousset (at) haw-hamburg.de>                *
+ *                                                                            *
+ * Distributed under the 3-clause BSD License.                                *
+ * See accompanying file LICENSE.                                             *
+\******************************************************************************/
+
+#ifndef SASH_SESSION_SERVER_HPP
+#define SASH_SESSION_SERVER_HPP
+
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <ostream>
+#include <algorithm>
+#include <functional>
+#include <unordered_map>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+
+#include "sash/command.hpp"
+#include "sash/pipeline.hpp"
+#include "sash/worker_pool.hpp"
+
+namespace sash {
+
+/// Serves command line sessions over a Unix domain socket. A single thread
+/// multiplexes all sessions on an epoll loop. Each connection gets its own
+/// command line, i.e., its own mode stack, preprocessors and variables,
+/// while the modes themselves can be shared between all sessions via
+/// `command_line::mode_add(mode_ptr)`. The protocol is line-based: the
+/// server sends the prompt of the current mode, executes each received
+/// line and replies with the output of the command, followed by
+/// `error: ...` on failure and the next prompt. Commands write their output
+/// via {@link output}. Since all sessions share one thread, long-running
+/// commands should run in the background on the worker pool that all
+/// sessions share. The server sends the notices of background jobs,
+/// including their output, as soon as a job finishes, followed by the
+/// prompt again. Closing a session leaves its running jobs to the pool.
+/// After the client shuts down its side of the connection, the server
+/// executes the remaining input and closes the session once all replies
+/// have been sent.
+/// @tparam CommandLine A `command_line` with a {@link session_backend}.
+template<class CommandLine>
+class session_server
+{
+  session_server(session_server const&) = delete;
+  session_server& operator=(session_server const&) = delete;
+
+public:
+  using command_line_type = CommandLine;
+
+  /// Initializes the command line of a new session, e.g., by adding the
+  /// shared modes, adding preprocessors and entering the initial mode.
+  using init_fun = std::function<void (command_line_type&)>;
+
+  /// The maximum number of bytes a client can send without a newline.
+  static constexpr size_t max_line_size = 64 * 1024;
+
+  /// Constructs a server whose sessions run background jobs on a shared
+  /// pool of @p num_workers threads, or of one thread per core if
+  /// @p num_workers is 0.
+  explicit session_server(init_fun init, size_t num_workers = 0)
+    : init_(std::move(init)),
+      pool_{std::make_shared<worker_pool>(num_workers)},
+      listen_fd_{-1},
+      epoll_fd_{-1},
+      wake_fd_{-1},
+      running_{false},
+      current_{nullptr},
+      commands_{0}
+  {
+    // nop
+  }
+
+  ~session_server()
+  {
+    // Detach all jobs first, since workers access mtx_, finished_ and
+    // wake_fd_ when a job finishes.
+    for (auto& kvp : sessions_)
+    {
+      kvp.second->cli.jobs().on_finish(nullptr);
+      ::close(kvp.first);
+    }
+    sessions_.clear();
+    for (auto fd : {listen_fd_, epoll_fd_, wake_fd_})
+      if (fd != -1)
+        ::close(fd);
+    if (! path_.empty())
+      ::unlink(path_.c_str());
+  }
+
+  /// Binds the server to the socket @p path, replacing stale sockets.
+  /// @returns `false` on error, in which case @p err describes the problem.
+  bool listen(std::string const& path, std::string& err)
+  {
+    sockaddr_un addr;
+    std::memset(&addr, 0, sizeof(addr));
+    if (path.size() >= sizeof(addr.sun_path))
+    {
+      err = "session_server: socket path too long";
+      return false;
+    }
+    addr.sun_family = AF_UNIX;
+    std::strcpy(addr.sun_path, path.c_str());
+    auto fail = [&](char const* what) -> bool
+    {
+      err = "session_server: ";
+      err += what;
+      err += ": ";
+      err += std::strerror(errno);
+      return false;
+    };
+    listen_fd_ = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                          0);
+    if (listen_fd_ == -1)
+      return fail("socket");
+    ::unlink(path.c_str());
+    if (::bind(listen_fd_, reinterpret_cast<sockaddr*>(&addr),
+               sizeof(addr)) != 0)
+      return fail("bind");
+    path_ = path;
+    if (::listen(listen_fd_, SOMAXCONN) != 0)
+      return fail("listen");
+    epoll_fd_ = ::epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd_ == -1)
+      return fail("epoll_create1");
+    wake_fd_ = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wake_fd_ == -1)
+      return fail("eventfd");
+    if (! watch(listen_fd_, EPOLLIN, EPOLL_CTL_ADD)
+        || ! watch(wake_fd_, EPOLLIN, EPOLL_CTL_ADD))
+      return fail("epoll_ctl");
+    return true;
+  }
+
+  /// Runs the event loop until {@link stop} gets called.
+  /// @pre `listen` succeeded.
+  void run()
+  {
+    running_ = true;
+    epoll_event events[256];
+    while (running_)
+    {
+      auto n = ::epoll_wait(epoll_fd_, events, 256, -1);
+      if (n < 0)
+      {
+        if (errno == EINTR)
+          continue;
+        return;
+      }
+      for (int i = 0; i < n; ++i)
+      {
+        auto fd = events[i].data.fd;
+        if (fd == wake_fd_)
+        {
+          uint64_t val;
+          while (::read(wake_fd_, &val, sizeof(val)) > 0)
+            ; // drain
+          report_jobs();
+        }
+        else if (fd == listen_fd_)
+        {
+          accept_all();
+        }
+        else
+        {
+          auto s = sessions_.find(fd);
+          if (s != sessions_.end())
+            handle(*s->second, events[i].events);
+        }
+      }
+    }
+  }
+
+  /// Stops the event loop. Safe to call from any thread.
+  void stop()
+  {
+    running_ = false;
+    wake();
+  }
+
+  /// Closes the session whose command is currently executing after sending
+  /// all pending output. Command handlers can call this to implement `quit`.
+  /// @returns `false` if no command is currently executing.
+  bool close_session()
+  {
+    if (current_ == nullptr)
+      return false;
+    current_->closing = true;
+    return true;
+  }
+
+  /// Returns the number of open sessions.
+  size_t num_sessions() const
+  {
+    return sessions_.size();
+  }
+
+  /// Returns the number of processed commands.
+  uint64_t num_commands() const
+  {
+    return commands_;
+  }
+
+private:
+  struct session
+  {
+    int fd;
+    bool closing;
+    // The events we currently watch for.
+    uint32_t events;
+    size_t sent;
+    std::string in;
+    std::string out;
+    command_line_type cli;
+  };
+
+  bool watch(int fd, uint32_t events, int op)
+  {
+    epoll_event ev;
+    ev.events = events;
+    ev.data.fd = fd;
+    return ::epoll_ctl(epoll_fd_, op, fd, &ev) == 0;
+  }
+
+  void accept_all()
+  {
+    for (;;)
+    {
+      auto fd = ::accept4(listen_fd_, nullptr, nullptr,
+                          SOCK_NONBLOCK | SOCK_CLOEXEC);
+      if (fd == -1)
+      {
+        if (errno == EINTR || errno == ECONNABORTED)
+          continue;
+        return; // EAGAIN or out of descriptors
+      }
+      std::unique_ptr<session> s{new session};
+      s->fd = fd;
+      s->closing = false;
+      s->events = EPOLLIN;
+      s->sent = 0;
+      s->cli.set_interruptible(false); // SIGINT belongs to the server
+      s->cli.jobs().set_pool(pool_);
+      if (init_)
+        init_(s->cli);
+      // Workers report finished jobs to the event loop.
+      s->cli.jobs().on_finish([this, fd]
+      {
+        {
+          std::unique_lock<std::mutex> guard{mtx_};
+          finished_.push_back(fd);
+        }
+        wake();
+      });
+      append_prompt(*s);
+      if (! watch(fd, EPOLLIN, EPOLL_CTL_ADD))
+      {
+        ::close(fd);
+        continue;
+      }
+      auto& ref = *s;
+      sessions_.emplace(fd, std::move(s));
+      flush(ref);
+    }
+  }
+
+  void handle(session& s, uint32_t events)
+  {
+    if (! s.closing && (events & (EPOLLIN | EPOLLHUP | EPOLLERR)))
+    {
+      char buf[4096];
+      for (;;)
+      {
+        auto n = ::read(s.fd, buf, sizeof(buf));
+        if (n > 0)
+        {
+          s.in.append(buf, static_cast<size_t>(n));
+          execute_lines(s);
+          if (s.closing)
+            break;
+          if (s.in.size() > max_line_size)
+          {
+            close(s);
+            return;
+          }
+          continue;
+        }
+        if (n < 0 && errno == EINTR)
+          continue;
+        if (n < 0 && errno == EAGAIN)
+          break;
+        if (n < 0)
+        {
+          // The connection failed, i.e., replies cannot be delivered.
+          close(s);
+          return;
+        }
+        // The client has sent everything, but may still read our replies.
+        if (! s.in.empty())
+        {
+          s.in += '\n';
+          execute_lines(s);
+        }
+        s.closing = true;
+        break;
+      }
+    }
+    flush(s);
+  }
+
+  // Executes all complete lines in the input buffer of `s`.
+  void execute_lines(session& s)
+  {
+    size_t pos = 0;
+    for (;;)
+    {
+      auto nl = s.in.find('\n', pos);
+      if (nl == std::string::npos || s.closing)
+        break;
+      auto end = nl;
+      if (end > pos && s.in[end - 1] == '\r')
+        --end;
+      line_.assign(s.in, pos, end - pos);
+      execute(s, line_);
+      pos = nl + 1;
+    }
+    s.in.erase(0, pos);
+  }
+
+  void execute(session& s, std::string const& line)
+  {
+    current_ = &s;
+    string_writer buf{s.out};
+    std::ostream os{&buf};
+    {
+      io_redirect guard{&os, nullptr};
+      if (s.cli.process(line) == no_command)
+      {
+        s.out += "error: ";
+        s.out += s.cli.last_error();
+        s.out += '\n';
+      }
+    }
+    current_ = nullptr;
+    ++commands_;
+    append_notices(s);
+    if (! s.closing)
+      append_prompt(s);
+  }
+
+  // Appends the notices of started and finished background jobs.
+  // @returns `true` if there were any.
+  bool append_notices(session& s)
+  {
+    auto size = s.out.size();
+    s.cli.jobs().drain_notices([&](std::string const& str)
+    {
+      s.out += str;
+      s.out += '\n';
+    });
+    return s.out.size() != size;
+  }
+
+  // Sends the notices of jobs that finished while their sessions waited
+  // for input, starting on a new line after the prompt.
+  void report_jobs()
+  {
+    std::vector<int> fds;
+    {
+      std::unique_lock<std::mutex> guard{mtx_};
+      fds.swap(finished_);
+    }
+    for (auto fd : fds)
+    {
+      auto i = sessions_.find(fd);
+      if (i == sessions_.end() || i->second->closing)
+        continue;
+      auto& s = *i->second;
+      auto size = s.out.size();
+      s.out += '\n';
+      if (append_notices(s))
+      {
+        append_prompt(s);
+        flush(s);
+      }
+      else
+      {
+        s.out.resize(size);
+      }
+    }
+  }
+
+  void wake()
+  {
+    uint64_t val = 1;
+    if (::write(wake_fd_, &val, sizeof(val)) < 0)
+      return; // the counter is saturated, i.e., wakeups are pending anyway
+  }
+
+  void append_prompt(session& s)
+  {
+    if (s.cli.has_mode())
+      s.out += s.cli.current_mode().backend().prompt();
+  }
+
+  // Writes pending output and watches for writability if the socket
+  // buffer is full. Closes `s` if requested and all output has been sent.
+  void flush(session& s)
+  {
+    while (s.sent < s.out.size())
+    {
+      auto n = ::send(s.fd, s.out.data() + s.sent, s.out.size() - s.sent,
+                      MSG_NOSIGNAL);
+      if (n < 0)
+      {
+        if (errno == EINTR)
+          continue;
+        if (errno == EAGAIN)
+          break;
+        close(s);
+        return;
+      }
+      s.sent += static_cast<size_t>(n);
+    }
+    auto pending = s.sent < s.out.size();
+    if (! pending)
+    {
+      s.out.clear();
+      s.sent = 0;
+      if (s.closing)
+      {
+        close(s);
+        return;
+      }
+    }
+    // A closing session no longer reads, which also avoids busy looping
+    // on the readable end of a half-closed connection.
+    uint32_t events = (s.closing ? 0u : uint32_t{EPOLLIN})
+                      | (pending ? uint32_t{EPOLLOUT} : 0u);
+    if (events != s.events)
+    {
+      s.events = events;
+      watch(s.fd, events, EPOLL_CTL_MOD);
+    }
+  }
+
+  void close(session& s)
+  {
+    auto fd = s.fd;
+    ::epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+    sessions_.erase(fd); // destroys s, but leaves its jobs running
+    {
+      // A new session may reuse the descriptor.
+      std::unique_lock<std::mutex> guard{mtx_};
+      finished_.erase(std::remove(finished_.begin(), finished_.end(), fd),
+                      finished_.end());
+    }
+    ::close(fd);
+  }
+
+  init_fun init_;
+  // Declared first, so that running jobs terminate last.
+  std::shared_ptr<worker_pool> pool_;
+  std::string path_;
+  int listen_fd_;
+  int epoll_fd_;
+  int wake_fd_;
+  std::atomic<bool> running_;
+  session* current_;
+  uint64_t commands_;
+  std::string line_;
+  // Sessions with finished jobs, filled by worker threads.
+  std::mutex mtx_;
+  std::vector<int> finished_;
+  std::unordered_map<int, std::unique_ptr<session>> sessions_;
+};
+
+template<class CommandLine>
+constexpr size_t session_server<CommandLine>::max_line_size;
+
+} // namespace sash
+
+#endif // SASH_SESSION_SERVER_HPP
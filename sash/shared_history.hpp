@@ -0,0 +1,243 @@
+/******************************************************************************
+ *                   ____     ______   ____     __  __                        *
+ *                  /\  _`\  /\  _  \ /\  _`\  /\ \/\ \                       *
+ *                  \ \,\L\_\\ \ \L\ \\ \,\L\_\\ \ \_\ \                      *
+ *                   \/_\__ \ \ \  __ \\/_\__ \ \ \  _  \                     *
+ *                     /\ \L\ \\ \ \/\ \ /\ \L\ \\ \ \ \ \                    *
+ *                     \ `\____\\ \_\ \_\\ `\____\\ \_\ \_\                   *
+ *                      \/_____/ \/_/\/_/ \/_____/ \/_/\/_/                   *
+ *                                                                            *
+ *                                                                            *
+ * Copyright (c) 2014                                                         *
+ * Matthias Vallentin <vallentin (at) icir.org>                               *
+ * Dominik Charousset <dominik.charousset (at) haw-hamburg.de>                *
+ *                                                                            *
+ * Distributed under the 3-clause BSD License.                                *
+ * See accompanying file LICENSE.                                             *
+\******************************************************************************/
+
+#ifndef SASH_SHARED_HISTORY_HPP
+#define SASH_SHARED_HISTORY_HPP
+
+#include <string>
+#include <vector>
+#include <cerrno>
+#include <cstddef>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+
+namespace sash {
+
+/// A history file that is safe to use from many shell sessions at once.
+/// Rather than rewriting the whole file on each save, a session appends new
+/// entries while holding an exclusive `flock` and picks up entries of other
+/// sessions by reading everything past its last known offset. The file stores
+/// one entry per line, with backslashes and newlines escaped. When another
+/// process truncates the file, a session skips its content at that point
+/// instead of reading the entries it already has a second time.
+class shared_history
+{
+  shared_history(shared_history const&) = delete;
+  shared_history& operator=(shared_history const&) = delete;
+
+public:
+  /// Opens or creates a shared history file.
+  /// @param filename The path of the history file.
+  /// @param unique Whether to drop entries equal to the entry preceding them
+  ///               in the file, like libedit's `H_SETUNIQUE`.
+  shared_history(std::string filename, bool unique = true)
+    : filename_{std::move(filename)},
+      unique_{unique},
+      offset_{0}
+  {
+    fd_ = ::open(filename_.c_str(), O_RDWR | O_APPEND | O_CREAT | O_CLOEXEC,
+                 0600);
+  }
+
+  ~shared_history()
+  {
+    if (fd_ != -1)
+      ::close(fd_);
+  }
+
+  /// Checks whether the history file could be opened.
+  bool valid() const
+  {
+    return fd_ != -1;
+  }
+
+  /// Returns the path of the history file.
+  std::string const& filename() const
+  {
+    return filename_;
+  }
+
+  /// Reads all entries appended since the last call.
+  /// @param f A functor taking a `std::string const&` that is called for each
+  ///          new entry, skipping consecutive duplicates in unique mode.
+  /// @returns The number of entries passed to *f*.
+  template<class F>
+  size_t merge(F f)
+  {
+    if (fd_ == -1)
+      return 0;
+    file_lock guard{fd_, LOCK_SH};
+    return read_new(f);
+  }
+
+  /// Appends an entry to the history file. Entries of other sessions that
+  /// precede it in the file are passed to *f* first, which keeps the local
+  /// history in the same order as the file.
+  /// @param entry The new history entry.
+  /// @param f A functor taking a `std::string const&`, see {@link merge}.
+  /// @returns `true` if *entry* has been written to the file, `false` if
+  ///          it repeats the last entry in unique mode or on an I/O error.
+  template<class F>
+  bool append(std::string const& entry, F f)
+  {
+    if (fd_ == -1)
+      return false;
+    file_lock guard{fd_, LOCK_EX};
+    read_new(f);
+    if (unique_ && entry == last_)
+      return false;
+    line_.clear();
+    escape(entry, line_);
+    line_ += '\n';
+    auto first = line_.data();
+    auto remaining = line_.size();
+    while (remaining > 0)
+    {
+      auto n = ::write(fd_, first, remaining);
+      if (n < 0)
+      {
+        if (errno == EINTR)
+          continue;
+        return false;
+      }
+      first += n;
+      remaining -= static_cast<size_t>(n);
+    }
+    last_ = entry;
+    // Skip our own line on the next merge.
+    struct stat st;
+    if (::fstat(fd_, &st) == 0)
+      offset_ = static_cast<size_t>(st.st_size);
+    return true;
+  }
+
+  /// Returns the last entry in the file as far as this session knows, i.e.,
+  /// the last entry passed to a functor or written by {@link append}.
+  std::string const& last() const
+  {
+    return last_;
+  }
+
+private:
+  // RAII wrapper for flock(2).
+  struct file_lock
+  {
+    file_lock(int fd, int operation) : fd_{fd}
+    {
+      while (::flock(fd_, operation) != 0 && errno == EINTR)
+        ; // try again
+    }
+
+    ~file_lock()
+    {
+      ::flock(fd_, LOCK_UN);
+    }
+
+    int fd_;
+  };
+
+  template<class F>
+  size_t read_new(F& f)
+  {
+    struct stat st;
+    if (::fstat(fd_, &st) != 0)
+      return 0;
+    auto size = static_cast<size_t>(st.st_size);
+    // Somebody truncated the file, e.g., to compact it. Reading it again
+    // would enter all entries a second time, so continue at its end.
+    if (size < offset_)
+      offset_ = size;
+    if (size == offset_)
+      return 0;
+    buf_.resize(size - offset_);
+    size_t got = 0;
+    while (got < buf_.size())
+    {
+      auto n = ::pread(fd_, buf_.data() + got, buf_.size() - got,
+                       static_cast<off_t>(offset_ + got));
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n <= 0)
+        break;
+      got += static_cast<size_t>(n);
+    }
+    // Only consume complete lines.
+    size_t result = 0;
+    size_t consumed = 0;
+    for (size_t i = 0; i < got; ++i)
+    {
+      if (buf_[i] != '\n')
+        continue;
+      line_.clear();
+      unescape(buf_.data() + consumed, buf_.data() + i, line_);
+      consumed = i + 1;
+      if (! line_.empty() && ! (unique_ && line_ == last_))
+      {
+        last_ = line_;
+        f(const_cast<std::string const&>(line_));
+        ++result;
+      }
+    }
+    offset_ += consumed;
+    return result;
+  }
+
+  static void escape(std::string const& in, std::string& out)
+  {
+    for (auto c : in)
+    {
+      if (c == '\\')
+        out += "\\\\";
+      else if (c == '\n')
+        out += "\\n";
+      else
+        out += c;
+    }
+  }
+
+  static void unescape(char const* first, char const* last, std::string& out)
+  {
+    for (; first != last; ++first)
+    {
+      if (*first == '\\' && first + 1 != last)
+      {
+        ++first;
+        out += *first == 'n' ? '\n' : *first;
+      }
+      else
+      {
+        out += *first;
+      }
+    }
+  }
+
+  int fd_;
+  std::string filename_;
+  bool unique_;
+  size_t offset_;
+  std::vector<char> buf_;
+  std::string line_;
+  std::string last_;
+};
+
+} // namespace sash
+
+#endif // SASH_SHARED_HISTORY_HPP
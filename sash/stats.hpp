@@ -0,0 +1,303 @@
+/******************************************************************************
+ *                   ____     ______   ____     __  __                        *
+ *                  /\  _`\  /\  _  \ /\  _`\  /\ \/\ \                       *
+ *                  \ \,\L\_\\ \ \L\ \\ \,\L\_\\ \ \_\ \                      *
+ *                   \/_\__ \ \ \  __ \\/_\__ \ \ \  _  \                     *
+ *                     /\ \L\ \\ \ \/\ \ /\ \L\ \\ \ \ \ \                    *
+ *                     \ `\____\\ \_\ \_\\ `\____\\ \_\ \_\                   *
+ *                      \/_____/ \/_/\/_/ \/_____/ \/_/\/_/                   *
+ *                                                                            *
+ *                                                                            *
+ * Copyright (c) 2014                                                         *
+ * Matthias Vallentin <vallentin (at) icir.org>                               *
+ * Dominik Charousset <dominik.charousset (at) haw-hamburg.de>                *
+ *                                                                            *
+ * Distributed under the 3-clause BSD License.                                *
+ * See accompanying file LICENSE.                                             *
+\******************************************************************************/
+
+#ifndef SASH_STATS_HPP
+#define SASH_STATS_HPP
+
+#include <map>
+#include <array>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <iomanip>
+#include <sstream>
+#include <algorithm>
+
+namespace sash {
+
+/// A latency histogram with logarithmic buckets, each of which is divided
+/// into 8 linear sub-buckets, i.e., recorded values have a relative error
+/// of at most 12.5% (similar to HDR histograms). Recording is wait-free and
+/// the histogram has a fixed size independent of the recorded range.
+class latency_histogram
+{
+  latency_histogram(latency_histogram const&) = delete;
+  latency_histogram& operator=(latency_histogram const&) = delete;
+
+public:
+  static constexpr size_t sub_buckets = 8;
+
+  static constexpr size_t num_buckets = 62 * sub_buckets;
+
+  latency_histogram()
+  {
+    reset();
+  }
+
+  /// Records a single value in nanoseconds.
+  void record(uint64_t ns)
+  {
+    buckets_[bucket_of(ns)].fetch_add(1, std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+    sum_.fetch_add(ns, std::memory_order_relaxed);
+    auto prev = max_.load(std::memory_order_relaxed);
+    while (prev < ns
+           && ! max_.compare_exchange_weak(prev, ns, std::memory_order_relaxed))
+      ; // try again
+  }
+
+  /// Returns the number of recorded values.
+  uint64_t count() const
+  {
+    return count_.load(std::memory_order_relaxed);
+  }
+
+  /// Returns the largest recorded value.
+  uint64_t max() const
+  {
+    return max_.load(std::memory_order_relaxed);
+  }
+
+  /// Returns the average of all recorded values.
+  uint64_t mean() const
+  {
+    auto n = count();
+    return n == 0 ? 0 : sum_.load(std::memory_order_relaxed) / n;
+  }
+
+  /// Returns an upper bound for the @p q-quantile, e.g., `percentile(0.99)`
+  /// for the 99th percentile.
+  uint64_t percentile(double q) const
+  {
+    auto n = count();
+    if (n == 0)
+      return 0;
+    auto rank = static_cast<uint64_t>(q * static_cast<double>(n));
+    if (rank >= n)
+      rank = n - 1;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < num_buckets; ++i)
+    {
+      seen += buckets_[i].load(std::memory_order_relaxed);
+      if (seen > rank)
+        return std::min(upper_bound_of(i), max());
+    }
+    return max();
+  }
+
+  /// Discards all recorded values.
+  void reset()
+  {
+    for (auto& x : buckets_)
+      x.store(0, std::memory_order_relaxed);
+    count_.store(0, std::memory_order_relaxed);
+    sum_.store(0, std::memory_order_relaxed);
+    max_.store(0, std::memory_order_relaxed);
+  }
+
+private:
+  // Values below 8 map to their own bucket. Larger values map to the
+  // bucket of their most significant bit plus the next three bits.
+  static size_t bucket_of(uint64_t x)
+  {
+    if (x < sub_buckets)
+      return static_cast<size_t>(x);
+    auto msb = static_cast<size_t>(63 - __builtin_clzll(x));
+    auto sub = static_cast<size_t>(x >> (msb - 3)) & (sub_buckets - 1);
+    auto i = (msb - 2) * sub_buckets + sub;
+    return i < num_buckets ? i : num_buckets - 1;
+  }
+
+  static uint64_t upper_bound_of(size_t i)
+  {
+    if (i < sub_buckets)
+      return i;
+    auto msb = i / sub_buckets + 2;
+    auto sub = i % sub_buckets;
+    return ((sub_buckets + sub + 1) << (msb - 3)) - 1;
+  }
+
+  std::array<std::atomic<uint64_t>, num_buckets> buckets_;
+  std::atomic<uint64_t> count_;
+  std::atomic<uint64_t> sum_;
+  std::atomic<uint64_t> max_;
+};
+
+/// Call counts per result and latencies of a single command path.
+class command_stats
+{
+  command_stats(command_stats const&) = delete;
+  command_stats& operator=(command_stats const&) = delete;
+
+public:
+  command_stats()
+  {
+    reset();
+  }
+
+  /// Records a call with result @p result that took @p ns nanoseconds.
+  /// @param result A `command_result`.
+  void record(int result, uint64_t ns)
+  {
+    results_[static_cast<size_t>(result) % 3].fetch_add(
+      1, std::memory_order_relaxed);
+    latency_.record(ns);
+  }
+
+  /// Records a call that replayed a cached result, in addition to
+  /// {@link record}.
+  void record_cache_hit()
+  {
+    cache_hits_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  /// Returns the number of calls with result @p result.
+  uint64_t calls(int result) const
+  {
+    return results_[static_cast<size_t>(result) % 3].load(
+      std::memory_order_relaxed);
+  }
+
+  /// Returns the number of calls that replayed a cached result.
+  uint64_t cache_hits() const
+  {
+    return cache_hits_.load(std::memory_order_relaxed);
+  }
+
+  latency_histogram const& latency() const
+  {
+    return latency_;
+  }
+
+  void reset()
+  {
+    for (auto& x : results_)
+      x.store(0, std::memory_order_relaxed);
+    cache_hits_.store(0, std::memory_order_relaxed);
+    latency_.reset();
+  }
+
+private:
+  std::array<std::atomic<uint64_t>, 3> results_;
+  std::atomic<uint64_t> cache_hits_;
+  latency_histogram latency_;
+};
+
+/// A point-in-time copy of the statistics for one command path. Latencies
+/// are in nanoseconds.
+struct command_stats_snapshot
+{
+  std::string path;
+  uint64_t executed;
+  uint64_t nop;
+  uint64_t failed;
+  uint64_t cache_hits;
+  uint64_t mean;
+  uint64_t p50;
+  uint64_t p90;
+  uint64_t p99;
+  uint64_t max;
+};
+
+/// Maps command paths to their statistics. Looking up a path is only
+/// required once per command when enabling statistics, recording happens
+/// directly on the {@link command_stats}.
+class stats_registry
+{
+  stats_registry(stats_registry const&) = delete;
+  stats_registry& operator=(stats_registry const&) = delete;
+
+public:
+  stats_registry() = default;
+
+  /// Returns the statistics for @p path, creating them if needed.
+  std::shared_ptr<command_stats> get(std::string const& path)
+  {
+    std::unique_lock<std::mutex> guard{mtx_};
+    auto& ptr = entries_[path];
+    if (! ptr)
+      ptr = std::make_shared<command_stats>();
+    return ptr;
+  }
+
+  /// Returns a snapshot of all paths that have been called at least once,
+  /// sorted by path.
+  std::vector<command_stats_snapshot> snapshot() const
+  {
+    std::vector<command_stats_snapshot> result;
+    std::unique_lock<std::mutex> guard{mtx_};
+    for (auto& kvp : entries_)
+    {
+      auto& x = *kvp.second;
+      auto& h = x.latency();
+      if (h.count() == 0)
+        continue;
+      // results are ordered as in command_result: executed, nop, no_command
+      result.push_back(command_stats_snapshot{
+        kvp.first, x.calls(0), x.calls(1), x.calls(2), x.cache_hits(),
+        h.mean(),
+        h.percentile(0.5), h.percentile(0.9), h.percentile(0.99), h.max()});
+    }
+    return result;
+  }
+
+  /// Discards all recorded values.
+  void reset()
+  {
+    std::unique_lock<std::mutex> guard{mtx_};
+    for (auto& kvp : entries_)
+      kvp.second->reset();
+  }
+
+  /// Renders the snapshot as a table with latencies in microseconds.
+  std::string to_string() const
+  {
+    auto xs = snapshot();
+    size_t width = 4;
+    for (auto& x : xs)
+      width = std::max(width, x.path.size());
+    std::ostringstream oss;
+    oss << std::left << std::setw(static_cast<int>(width)) << "path"
+        << std::right << std::setw(10) << "ok" << std::setw(8) << "nop"
+        << std::setw(8) << "failed" << std::setw(8) << "cached"
+        << std::setw(11) << "mean(us)"
+        << std::setw(10) << "p50(us)" << std::setw(10) << "p99(us)"
+        << std::setw(10) << "max(us)" << "\n";
+    oss << std::fixed << std::setprecision(1);
+    auto us = [](uint64_t ns) { return static_cast<double>(ns) / 1000.; };
+    for (auto& x : xs)
+      oss << std::left << std::setw(static_cast<int>(width)) << x.path
+          << std::right << std::setw(10) << x.executed << std::setw(8)
+          << x.nop << std::setw(8) << x.failed << std::setw(8)
+          << x.cache_hits << std::setw(11) << us(x.mean)
+          << std::setw(10) << us(x.p50) << std::setw(10) << us(x.p99)
+          << std::setw(10) << us(x.max) << "\n";
+    return oss.str();
+  }
+
+private:
+  mutable std::mutex mtx_;
+  std::map<std::string, std::shared_ptr<command_stats>> entries_;
+};
+
+} // namespace sash
+
+#endif // SASH_STATS_HPP
@@ -0,0 +1,326 @@
+/******************************************************************************
+ *                   ____     ______   ____     __  __                        *
+ *                  /\  _`\  /\  _  \ /\  _`\  /\ \/\ \                       *
+ *                  \ \,\L\_\\ \ \L\ \\ \,\L\_\\ \ \_\ \                      *
+ *                   \/_\__ \ \ \  __ \\/_\__ \ \ \  _  \                     *
+ *                     /\ \L\ \\ \ \/\ \ /\ \L\ \\ \ \ \ \                    *
+ *                     \ `\____\\ \_\ \_\\ `\____\\ \_\ \_\                   *
+ *                      \/_____/ \/_/\/_/ \/_____/ \/_/\/_/                   *
+ *                                                                            *
+ *                                                                            *
+ * Copyright (c) 2014                                                         *
+ * Matthias Vallentin <vallentin (at) icir.org>                               *
+ * Dominik Charousset <dominik.charousset (at) haw-hamburg.de>                *
+ *                                                                            *
+ * Distributed under the 3-clause BSD License.                                *
+ * See accompanying file LICENSE.                                             *
+\******************************************************************************/
+
+#ifndef SASH_STYLE_HPP
+#define SASH_STYLE_HPP
+
+#include <atomic>
+#include <string>
+#include <cstdlib>
+#include <cstring>
+
+#include <unistd.h>
+
+#include "sash/io.hpp"
+#include "sash/color.hpp"
+
+namespace sash {
+
+/// Detects whether a file descriptor refers to a terminal that understands
+/// ANSI colors. Output to pipes and files, `TERM=dumb` and a non-empty
+/// `NO_COLOR` disable colors, while a `CLICOLOR_FORCE` other than `0`
+/// enables them unconditionally.
+class terminal
+{
+public:
+  /// Checks whether @p fd supports colors. The result for the standard
+  /// streams is computed once and then cached.
+  static bool colors(int fd = STDOUT_FILENO)
+  {
+    if (fd < 0 || fd > 2)
+      return detect(fd);
+    auto& x = cache()[fd];
+    auto state = x.load(std::memory_order_relaxed);
+    if (state < 0)
+    {
+      state = detect(fd) ? 1 : 0;
+      x.store(state, std::memory_order_relaxed);
+    }
+    return state == 1;
+  }
+
+  /// Overrides the detection for the standard stream @p fd.
+  static void colors(int fd, bool enabled)
+  {
+    if (fd >= 0 && fd <= 2)
+      cache()[fd].store(enabled ? 1 : 0, std::memory_order_relaxed);
+  }
+
+  /// Checks the environment and @p fd without caching.
+  static bool detect(int fd)
+  {
+    auto env = [](char const* name) -> char const*
+    {
+      auto str = std::getenv(name);
+      return str != nullptr && *str != '\0' ? str : nullptr;
+    };
+    if (env("NO_COLOR") != nullptr)
+      return false;
+    auto force = env("CLICOLOR_FORCE");
+    if (force != nullptr && std::strcmp(force, "0") != 0)
+      return true;
+    if (! ::isatty(fd))
+      return false;
+    auto term = env("TERM");
+    return term != nullptr && std::strcmp(term, "dumb") != 0;
+  }
+
+private:
+  // -1 means not detected yet.
+  static std::atomic<int>* cache()
+  {
+    static std::atomic<int> states[3] = {{-1}, {-1}, {-1}};
+    return states;
+  }
+};
+
+/// Checks whether handlers should style their {@link output}, i.e., whether
+/// it goes directly to a color terminal rather than to a pipeline stage or
+/// a capture buffer.
+inline bool output_colors()
+{
+  return detail::output_ptr() == nullptr && terminal::colors(STDOUT_FILENO);
+}
+
+namespace style {
+
+/// A sequence of characters known at compile time.
+template<char... Cs>
+struct chars
+{
+  static constexpr char value[] = {Cs..., '\0'};
+
+  static constexpr size_t size = sizeof...(Cs);
+};
+
+template<char... Cs>
+constexpr char chars<Cs...>::value[];
+
+template<char... Cs>
+constexpr size_t chars<Cs...>::size;
+
+/// The parameter of a Select Graphic Rendition (SGR) attribute.
+template<char... Cs>
+struct attribute
+{
+  // nop
+};
+
+using bold        = attribute<'1'>;
+using dim         = attribute<'2'>;
+using italic      = attribute<'3'>;
+using underline   = attribute<'4'>;
+using black       = attribute<'3', '0'>;
+using red         = attribute<'3', '1'>;
+using green       = attribute<'3', '2'>;
+using yellow      = attribute<'3', '3'>;
+using blue        = attribute<'3', '4'>;
+using magenta     = attribute<'3', '5'>;
+using cyan        = attribute<'3', '6'>;
+using white       = attribute<'3', '7'>;
+using grey        = attribute<'9', '0'>;
+using on_black    = attribute<'4', '0'>;
+using on_red      = attribute<'4', '1'>;
+using on_green    = attribute<'4', '2'>;
+using on_yellow   = attribute<'4', '3'>;
+using on_blue     = attribute<'4', '4'>;
+using on_magenta  = attribute<'4', '5'>;
+using on_cyan     = attribute<'4', '6'>;
+using on_white    = attribute<'4', '7'>;
+
+namespace detail {
+
+template<class T, class U>
+struct concat;
+
+template<char... Cs, char... Ds>
+struct concat<chars<Cs...>, chars<Ds...>>
+{
+  using type = chars<Cs..., Ds...>;
+};
+
+template<class... Ts>
+struct join;
+
+template<char... Cs>
+struct join<attribute<Cs...>>
+{
+  using type = chars<Cs...>;
+};
+
+template<char... Cs, class T, class... Ts>
+struct join<attribute<Cs...>, T, Ts...>
+{
+  using type = typename concat<chars<Cs..., ';'>,
+                               typename join<T, Ts...>::type>::type;
+};
+
+} // namespace detail
+
+/// The escape sequence enabling all attributes in @p Ts, composed at
+/// compile time, e.g., `sgr<bold, red>::value` is `"\033[1;31m"`.
+template<class... Ts>
+using sgr = typename detail::concat<
+  chars<'\033', '['>,
+  typename detail::concat<typename detail::join<Ts...>::type,
+                          chars<'m'>>::type>::type;
+
+/// The escape sequence resetting all attributes.
+using reset = chars<'\033', '[', '0', 'm'>;
+
+} // namespace style
+
+/// Composes styled text in a caller-provided buffer without allocating.
+/// Escape sequences are omitted if colors are disabled and text beyond the
+/// capacity of the buffer is truncated.
+class styled_buffer
+{
+public:
+  styled_buffer(char* first, size_t capacity, bool colors)
+    : first_{first},
+      pos_{first},
+      last_{first + capacity},
+      colors_{colors},
+      truncated_{false}
+  {
+    // nop
+  }
+
+  template<size_t N>
+  explicit styled_buffer(char (&buf)[N], bool colors = output_colors())
+    : styled_buffer(buf, N, colors)
+  {
+    // nop
+  }
+
+  /// Appends @p n characters of @p str.
+  styled_buffer& append(char const* str, size_t n)
+  {
+    auto avail = static_cast<size_t>(last_ - pos_);
+    if (n > avail)
+    {
+      n = avail;
+      truncated_ = true;
+    }
+    std::memcpy(pos_, str, n);
+    pos_ += n;
+    return *this;
+  }
+
+  styled_buffer& append(std::string const& str)
+  {
+    return append(str.data(), str.size());
+  }
+
+  /// Appends @p n copies of @p c.
+  styled_buffer& fill(char c, size_t n)
+  {
+    auto avail = static_cast<size_t>(last_ - pos_);
+    if (n > avail)
+    {
+      n = avail;
+      truncated_ = true;
+    }
+    std::memset(pos_, c, n);
+    pos_ += n;
+    return *this;
+  }
+
+  /// Appends @p str in style @p Style, e.g., `style::sgr<style::bold>`.
+  template<class Style>
+  styled_buffer& styled(char const* str, size_t n)
+  {
+    if (colors_)
+      append(Style::value, Style::size);
+    append(str, n);
+    if (colors_)
+      append(style::reset::value, style::reset::size);
+    return *this;
+  }
+
+  template<class Style>
+  styled_buffer& styled(std::string const& str)
+  {
+    return styled<Style>(str.data(), str.size());
+  }
+
+  /// Appends @p str in the runtime color @p c.
+  styled_buffer& styled(color::type c, char const* str, size_t n)
+  {
+    auto colored = colors_ && c != color::none;
+    if (colored)
+      append(c, std::strlen(c));
+    append(str, n);
+    if (colored)
+      append(color::reset, sizeof(color::reset) - 1);
+    return *this;
+  }
+
+  char const* data() const
+  {
+    return first_;
+  }
+
+  size_t size() const
+  {
+    return static_cast<size_t>(pos_ - first_);
+  }
+
+  bool colors() const
+  {
+    return colors_;
+  }
+
+  /// Checks whether the buffer was too small for the appended text.
+  bool truncated() const
+  {
+    return truncated_;
+  }
+
+  void clear()
+  {
+    pos_ = first_;
+    truncated_ = false;
+  }
+
+private:
+  char* first_;
+  char* pos_;
+  char* last_;
+  bool colors_;
+  bool truncated_;
+};
+
+/// Appends @p str in color @p c to @p dst with a single allocation at most,
+/// dropping the color if @p colors is `false`.
+inline void append_styled(std::string& dst, color::type c,
+                          std::string const& str, bool colors)
+{
+  if (str.empty())
+    return;
+  auto clen = colors && c != color::none ? std::strlen(c) : 0;
+  auto rlen = clen > 0 ? sizeof(color::reset) - 1 : 0;
+  auto pos = dst.size();
+  dst.resize(pos + clen + str.size() + rlen);
+  styled_buffer buf{&dst[pos], dst.size() - pos, clen > 0};
+  buf.styled(c, str.data(), str.size());
+}
+
+} // namespace sash
+
+#endif // SASH_STYLE_HPP
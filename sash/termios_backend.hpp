@@ -0,0 +1,889 @@
+/******************************************************************************
+ *                   ____     ______   ____     __  __                        *
+ *                  /\  _`\  /\  _  \ /\  _`\  /\ \/\ \                       *
+ *                  \ \,\L\_\\ \ \L\ \\ \,\L\_\\ \ \_\ \                      *
+ *                   \/_\__ \ \ \  __ \\/_\__ \ \ \  _  \                     *
+ *                     /\ \L\ \\ \ \/\ \ /\ \L\ \\ \ \ \ \                    *
+ *                     \ `\____\\ \_\ \_\\ `\____\\ \_\ \_\                   *
+ *                      \/_____/ \/_/\/_/ \/_____/ \/_/\/_/                   *
+ *                                                                            *
+ *                                                                            *
+ * Copyright (c) 2014                                                         *
+ * Matthias Vallentin <vallentin (at) icir.org>                               *
+ * Dominik Charousset <dominik.charousset (at) haw-hamburg.de>                *
+ *                                                                            *
+ * Distributed under the 3-clause BSD License.                                *
+ * See accompanying file LICENSE.                                             *
+\******************************************************************************/
+
+#ifndef SASH_TERMIOS_BACKEND_HPP
+#define SASH_TERMIOS_BACKEND_HPP
+
+#include <deque>
+#include <memory>
+#include <string>
+#include <cctype>
+#include <cerrno>
+#include <csignal>
+#include <fstream>
+#include <algorithm>
+
+#include <unistd.h>
+#include <signal.h>
+#include <termios.h>
+#include <sys/ioctl.h>
+
+#include "sash/color.hpp"
+#include "sash/style.hpp"
+#include "sash/completer.hpp"
+#include "sash/output_queue.hpp"
+#include "sash/dynamic_prompt.hpp"
+
+namespace sash {
+
+/// A line editor implemented directly on top of termios and ANSI escape
+/// sequences, i.e., without depending on libedit. After each batch of
+/// input, the backend compares the line on screen with the edited line and
+/// emits only the difference: it moves the cursor to the first changed
+/// column, rewrites the changed tail and erases leftovers. All output of a
+/// batch goes to the terminal in a single `write(2)`, which keeps the
+/// number of packets per keystroke at one when running over SSH.
+///
+/// The editor supports the common emacs bindings (`^A`, `^E`, `^B`, `^F`,
+/// `^K`, `^U`, `^W`, `^D`, `^L`, `^P`, `^N`), arrow keys, Home, End and
+/// Delete. Other keys with escape sequences are ignored. Lines wider than
+/// the terminal fall back to redrawing all rows, as does resizing the
+/// terminal while editing.
+/// The editor counts each code point as one column. If the input is no TTY,
+/// the backend reads plain lines without editing. The history file contains
+/// one entry per line. Output posted to an {@link output_queue} appears
+/// above the prompt while the user edits a line.
+template<class Completer>
+class termios_backend
+{
+public:
+  using completer_type = Completer;
+
+  using completer_pointer = std::shared_ptr<Completer>;
+
+  /// Counts the system calls issued by the editor.
+  struct io_stats
+  {
+    /// Number of `read(2)` calls.
+    size_t reads;
+    /// Number of `write(2)` calls.
+    size_t writes;
+    /// Number of bytes written.
+    size_t bytes;
+  };
+
+  /// Constructs a backend reading from `STDIN_FILENO` and writing to
+  /// `STDOUT_FILENO`.
+  /// @param history_filename The file for loading and saving the history.
+  /// @param completion_key The key that triggers completion. Only
+  ///                       single-byte keys are supported, e.g., `"\t"`.
+  termios_backend(char const* = "sash",
+                  std::string history_filename = "",
+                  int history_size = 1000,
+                  bool unique_history = true,
+                  std::string completion_key = "\t")
+    : in_{STDIN_FILENO},
+      out_{STDOUT_FILENO},
+      history_filename_{std::move(history_filename)},
+      history_size_{history_size > 0 ? static_cast<size_t>(history_size) : 0},
+      unique_history_{unique_history},
+      comp_key_{completion_key.size() == 1 ? completion_key[0] : '\t'},
+      completer_{std::make_shared<Completer>()},
+      raw_{false},
+      editing_{false},
+      eof_{false},
+      first_{0},
+      last_{0},
+      stats_{0, 0, 0}
+  {
+    history_load();
+  }
+
+  ~termios_backend()
+  {
+    leave_raw();
+  }
+
+  /// Sets the file descriptors for input and output.
+  void set_fds(int in, int out)
+  {
+    leave_raw();
+    in_ = in;
+    out_ = out;
+  }
+
+  /// Prints messages from @p queue above the prompt while reading a line.
+  void set_output_queue(std::shared_ptr<output_queue> queue)
+  {
+    queue_ = std::move(queue);
+  }
+
+  /// Restores the terminal settings.
+  void reset()
+  {
+    leave_raw();
+  }
+
+  /// Writes the history to file.
+  void history_save()
+  {
+    if (history_filename_.empty())
+      return;
+    std::ofstream f{history_filename_, std::ios::trunc};
+    for (auto& entry : history_)
+      f << entry << '\n';
+  }
+
+  /// Reads the history from file.
+  void history_load()
+  {
+    if (history_filename_.empty())
+      return;
+    std::ifstream f{history_filename_};
+    std::string entry;
+    while (std::getline(f, entry))
+      if (! entry.empty())
+        history_add(entry);
+  }
+
+  void history_add(std::string const& str)
+  {
+    if (history_size_ == 0
+        || (unique_history_ && ! history_.empty() && history_.back() == str))
+      return;
+    if (history_.size() == history_size_)
+      history_.pop_front();
+    history_.push_back(str);
+  }
+
+  void history_enter(std::string const& str)
+  {
+    history_add(str);
+  }
+
+  /// Returns the history, oldest entry first.
+  std::deque<std::string> const& history() const
+  {
+    return history_;
+  }
+
+  /// Sets a (colored) string as prompt for the shell.
+  void set_prompt(std::string str, color::type c = color::none)
+  {
+    dynamic_prompt_.reset();
+    prompt_.clear();
+    add_to_prompt(std::move(str), c);
+  }
+
+  /// Sets a prompt that the backend renders whenever it draws the prompt,
+  /// i.e., at the start of each line and after printing queued output.
+  void set_prompt(std::shared_ptr<dynamic_prompt> ptr)
+  {
+    dynamic_prompt_ = std::move(ptr);
+  }
+
+  /// Appends a (colored) string to the static prompt. The color is
+  /// dropped unless the output is a color terminal.
+  void add_to_prompt(std::string str, color::type c = color::none)
+  {
+    append_styled(prompt_, c, str, terminal::colors(out_));
+  }
+
+  /// Returns the current prompt.
+  std::string const& prompt() const
+  {
+    return dynamic_prompt_ ? dynamic_prompt_->render() : prompt_;
+  }
+
+  /// Checks whether we've reached the end of file.
+  bool eof() const
+  {
+    return eof_;
+  }
+
+  /// Reads a character.
+  bool read_char(char& c)
+  {
+    if (eof_)
+      return false;
+    enter_raw();
+    auto result = next(c);
+    leave_raw();
+    return result;
+  }
+
+  /// Reads a line.
+  bool read_line(std::string& line)
+  {
+    if (eof_)
+      return false;
+    if (! ::isatty(in_))
+      return read_plain(line);
+    enter_raw();
+    begin_line();
+    auto result = edit();
+    leave_raw();
+    if (result)
+      line = line_;
+    return result;
+  }
+
+  completer_pointer get_completer()
+  {
+    return completer_;
+  }
+
+  /// Returns the number of system calls issued so far.
+  io_stats const& stats() const
+  {
+    return stats_;
+  }
+
+private:
+  // -- terminal setup -------------------------------------------------------
+
+  void enter_raw()
+  {
+    if (raw_ || ! ::isatty(in_) || ::tcgetattr(in_, &orig_) == -1)
+      return;
+    auto t = orig_;
+    t.c_iflag &= ~static_cast<tcflag_t>(BRKINT | ICRNL | INPCK | ISTRIP
+                                        | IXON);
+    t.c_cflag |= CS8;
+    t.c_lflag &= ~static_cast<tcflag_t>(ECHO | ICANON | IEXTEN | ISIG);
+    t.c_cc[VMIN] = 1;
+    t.c_cc[VTIME] = 0;
+    raw_ = ::tcsetattr(in_, TCSADRAIN, &t) == 0;
+    if (! raw_)
+      return;
+    // Without SA_RESTART, a resize interrupts a blocking read.
+    struct sigaction sa;
+    sa.sa_handler = on_winch;
+    sa.sa_flags = 0;
+    sigemptyset(&sa.sa_mask);
+    ::sigaction(SIGWINCH, &sa, &orig_winch_);
+  }
+
+  void leave_raw()
+  {
+    if (! raw_)
+      return;
+    ::sigaction(SIGWINCH, &orig_winch_, nullptr);
+    ::tcsetattr(in_, TCSADRAIN, &orig_);
+    raw_ = false;
+  }
+
+  static volatile std::sig_atomic_t& winched()
+  {
+    static volatile std::sig_atomic_t flag = 0;
+    return flag;
+  }
+
+  static void on_winch(int)
+  {
+    winched() = 1;
+  }
+
+  size_t terminal_width() const
+  {
+    winsize ws;
+    if (::ioctl(out_, TIOCGWINSZ, &ws) == -1 || ws.ws_col == 0)
+      return 80;
+    return ws.ws_col;
+  }
+
+  // -- input ----------------------------------------------------------------
+
+  bool buffered() const
+  {
+    return first_ != last_;
+  }
+
+  // Returns the next input byte, blocking only if the buffer is empty.
+  bool next(char& c)
+  {
+    while (! buffered())
+    {
+      if (queue_ && editing_ && ! queue_->wait(in_))
+      {
+        print_queued();
+        continue;
+      }
+      if (editing_ && winched())
+      {
+        resize();
+        continue;
+      }
+      ++stats_.reads;
+      auto n = ::read(in_, buf_, sizeof(buf_));
+      if (n > 0)
+      {
+        first_ = 0;
+        last_ = static_cast<size_t>(n);
+      }
+      else if (n == 0 || errno != EINTR)
+      {
+        eof_ = true;
+        return false;
+      }
+    }
+    c = buf_[first_++];
+    return true;
+  }
+
+  // Reads a line without editing, prompt or echo if the input is no TTY.
+  bool read_plain(std::string& line)
+  {
+    line.clear();
+    char c;
+    while (next(c))
+    {
+      if (c == '\n')
+        return true;
+      line += c;
+    }
+    return ! line.empty();
+  }
+
+  // -- output ---------------------------------------------------------------
+
+  void flush()
+  {
+    size_t pos = 0;
+    while (pos < pending_.size())
+    {
+      ++stats_.writes;
+      auto n = ::write(out_, pending_.data() + pos, pending_.size() - pos);
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n <= 0)
+        break;
+      pos += static_cast<size_t>(n);
+      stats_.bytes += static_cast<size_t>(n);
+    }
+    pending_.clear();
+  }
+
+  void csi(size_t n, char cmd)
+  {
+    pending_ += "\x1b[";
+    if (n != 1)
+      pending_ += std::to_string(n);
+    pending_ += cmd;
+  }
+
+  static bool continuation(char c)
+  {
+    return (static_cast<unsigned char>(c) & 0xC0) == 0x80;
+  }
+
+  // Returns the number of columns of the UTF-8 string in [first, last).
+  static size_t columns(std::string const& str, size_t first, size_t last)
+  {
+    size_t n = 0;
+    for (auto i = first; i < last; ++i)
+      if (! continuation(str[i]))
+        ++n;
+    return n;
+  }
+
+  // Returns the number of columns of the last prompt line, skipping escape
+  // sequences such as colors.
+  static size_t visible_width(std::string const& str)
+  {
+    auto nl = str.rfind('\n');
+    size_t n = 0;
+    for (auto i = nl == std::string::npos ? 0 : nl + 1; i < str.size(); ++i)
+    {
+      if (str[i] == '\x1b')
+      {
+        while (i + 1 < str.size()
+               && ! std::isalpha(static_cast<unsigned char>(str[i + 1])))
+          ++i;
+        ++i;
+      }
+      else if (! continuation(str[i]))
+      {
+        ++n;
+      }
+    }
+    return n;
+  }
+
+  // -- editing --------------------------------------------------------------
+
+  void begin_line()
+  {
+    line_.clear();
+    cursor_ = 0;
+    shown_.clear();
+    shown_cursor_ = 0;
+    cursor_row_ = 0;
+    wide_ = false;
+    winched() = 0;
+    width_ = terminal_width();
+    auto& str = prompt();
+    prompt_width_ = dynamic_prompt_ ? dynamic_prompt_->width()
+                                    : visible_width(str);
+    history_pos_ = history_.size();
+    if (queue_ && queue_->pending())
+      queue_->take(pending_);
+    pending_ += str;
+    flush();
+  }
+
+  // Processes keystrokes until the user enters a line or input ends,
+  // rendering once per batch of input.
+  bool edit()
+  {
+    editing_ = true;
+    auto result = edit_loop();
+    editing_ = false;
+    return result;
+  }
+
+  bool edit_loop()
+  {
+    for (;;)
+    {
+      char c;
+      if (! next(c))
+      {
+        flush();
+        return false;
+      }
+      switch (process(c))
+      {
+        default:
+          break;
+        case key_enter:
+          cursor_ = line_.size();
+          render();
+          pending_ += "\r\n";
+          flush();
+          return true;
+        case key_eof:
+          pending_ += "\r\n";
+          flush();
+          eof_ = true;
+          return false;
+      }
+      if (! buffered() && ! partial())
+      {
+        render();
+        flush();
+      }
+    }
+  }
+
+  enum key_action
+  {
+    key_edit,
+    key_enter,
+    key_eof
+  };
+
+  key_action process(char c)
+  {
+    if (c == comp_key_)
+    {
+      complete();
+      return key_edit;
+    }
+    switch (c)
+    {
+      case '\r':
+      case '\n':
+        return key_enter;
+      case 0x01: // ^A
+        cursor_ = 0;
+        break;
+      case 0x02: // ^B
+        left();
+        break;
+      case 0x03: // ^C
+        cursor_ = line_.size();
+        render();
+        pending_ += "^C\r\n";
+        begin_line();
+        break;
+      case 0x04: // ^D
+        if (line_.empty())
+          return key_eof;
+        erase_right();
+        break;
+      case 0x05: // ^E
+        cursor_ = line_.size();
+        break;
+      case 0x06: // ^F
+        right();
+        break;
+      case 0x08: // ^H
+      case 0x7f: // Backspace
+        if (cursor_ > 0)
+        {
+          auto end = cursor_;
+          left();
+          line_.erase(cursor_, end - cursor_);
+        }
+        break;
+      case 0x0b: // ^K
+        line_.erase(cursor_);
+        break;
+      case 0x0c: // ^L
+        pending_ += "\x1b[H\x1b[2J";
+        {
+          auto line = std::move(line_);
+          auto cursor = cursor_;
+          begin_line();
+          line_ = std::move(line);
+          cursor_ = cursor;
+        }
+        break;
+      case 0x0e: // ^N
+        history_next();
+        break;
+      case 0x10: // ^P
+        history_prev();
+        break;
+      case 0x15: // ^U
+        line_.erase(0, cursor_);
+        cursor_ = 0;
+        break;
+      case 0x17: // ^W
+        {
+          auto end = cursor_;
+          while (cursor_ > 0 && line_[cursor_ - 1] == ' ')
+            --cursor_;
+          while (cursor_ > 0 && line_[cursor_ - 1] != ' ')
+            --cursor_;
+          line_.erase(cursor_, end - cursor_);
+        }
+        break;
+      case 0x1b:
+        escape();
+        break;
+      default:
+        if (static_cast<unsigned char>(c) >= 0x20)
+          line_.insert(cursor_++, 1, c);
+    }
+    return key_edit;
+  }
+
+  // Handles CSI and SS3 sequences for cursor keys, Home, End and Delete.
+  // Consumes any other sequence up to its final byte and ignores it.
+  void escape()
+  {
+    char c;
+    if (! next(c))
+      return;
+    if (c == 'O')
+    {
+      if (next(c))
+        cursor_key(c, 0);
+      return;
+    }
+    if (c != '[')
+      return;
+    // Parameter and intermediate bytes range from 0x20 to 0x3f and the
+    // final byte from 0x40 to 0x7e.
+    size_t n = 0;
+    auto plain = true;
+    for (;;)
+    {
+      if (! next(c) || c < 0x20 || c > 0x7e)
+        return;
+      if (c >= 0x40)
+        break;
+      if (c >= '0' && c <= '9')
+        n = n * 10 + static_cast<size_t>(c - '0');
+      else
+        plain = false;
+    }
+    // Skip modified keys, e.g., Ctrl+Right as "\x1b[1;5C".
+    if (plain)
+      cursor_key(c, n);
+  }
+
+  void cursor_key(char c, size_t n)
+  {
+    switch (c)
+    {
+      case 'A':
+        history_prev();
+        break;
+      case 'B':
+        history_next();
+        break;
+      case 'C':
+        right();
+        break;
+      case 'D':
+        left();
+        break;
+      case 'H':
+        cursor_ = 0;
+        break;
+      case 'F':
+        cursor_ = line_.size();
+        break;
+      case '~':
+        if (n == 1 || n == 7)
+          cursor_ = 0;
+        else if (n == 4 || n == 8)
+          cursor_ = line_.size();
+        else if (n == 3)
+          erase_right();
+        break;
+    }
+  }
+
+  // Checks whether the code point before the cursor misses bytes that
+  // have not arrived yet.
+  bool partial() const
+  {
+    auto i = cursor_;
+    while (i > 0 && continuation(line_[i - 1]))
+      --i;
+    if (i == 0)
+      return false;
+    auto lead = static_cast<unsigned char>(line_[i - 1]);
+    auto n = lead >= 0xF0 ? 4u : lead >= 0xE0 ? 3u : lead >= 0xC0 ? 2u : 1u;
+    return cursor_ - i + 1 < n;
+  }
+
+  void left()
+  {
+    while (cursor_ > 0 && continuation(line_[--cursor_]))
+      ; // skip to start of code point
+  }
+
+  void right()
+  {
+    if (cursor_ < line_.size())
+      while (++cursor_ < line_.size() && continuation(line_[cursor_]))
+        ; // skip to start of next code point
+  }
+
+  void erase_right()
+  {
+    auto pos = cursor_;
+    right();
+    line_.erase(pos, cursor_ - pos);
+    cursor_ = pos;
+  }
+
+  void history_prev()
+  {
+    if (history_pos_ == 0)
+      return;
+    if (history_pos_ == history_.size())
+      saved_ = line_;
+    line_ = history_[--history_pos_];
+    cursor_ = line_.size();
+  }
+
+  void history_next()
+  {
+    if (history_pos_ == history_.size())
+      return;
+    ++history_pos_;
+    line_ = history_pos_ == history_.size() ? saved_
+                                            : history_[history_pos_];
+    cursor_ = line_.size();
+  }
+
+  void complete()
+  {
+    std::string result;
+    if (completer_->complete(result, line_.substr(0, cursor_)) != completed)
+    {
+      pending_ += '\a';
+      return;
+    }
+    line_.insert(cursor_, result);
+    cursor_ += result.size();
+  }
+
+  // -- rendering ------------------------------------------------------------
+
+  // Brings the screen up to date with the line and cursor position.
+  void render()
+  {
+    if (wide_ || prompt_width_ + columns(line_, 0, line_.size()) >= width_)
+    {
+      render_rows();
+      return;
+    }
+    // Find the first difference, at a code point boundary.
+    auto n = std::min(shown_.size(), line_.size());
+    size_t p = 0;
+    while (p < n && shown_[p] == line_[p])
+      ++p;
+    while (p > 0 && ((p < line_.size() && continuation(line_[p]))
+                     || (p < shown_.size() && continuation(shown_[p]))))
+      --p;
+    if (p == shown_.size() && p == line_.size())
+    {
+      move(shown_, shown_cursor_, cursor_);
+    }
+    else
+    {
+      move(shown_, shown_cursor_, p);
+      pending_.append(line_, p, std::string::npos);
+      if (columns(shown_, p, shown_.size()) > columns(line_, p, line_.size()))
+        pending_ += "\x1b[K";
+      move(line_, line_.size(), cursor_);
+    }
+    shown_ = line_;
+    shown_cursor_ = cursor_;
+  }
+
+  // Moves the cursor from byte offset `from` to `to` within `str`. Moving
+  // right rewrites the characters in between if that is shorter than a
+  // control sequence.
+  void move(std::string const& str, size_t from, size_t to)
+  {
+    if (to < from)
+    {
+      auto n = columns(str, to, from);
+      if (n == 1)
+        pending_ += '\b';
+      else
+        csi(n, 'D');
+    }
+    else if (to > from)
+    {
+      auto n = columns(str, from, to);
+      if (to - from <= 3 + (n > 9 ? 2 : 1))
+        pending_.append(str, from, to - from);
+      else
+        csi(n, 'C');
+    }
+  }
+
+  // Redraws prompt and line across multiple rows, used when the line does
+  // not fit into a single row of the terminal.
+  void render_rows()
+  {
+    if (cursor_row_ > 0)
+      csi(cursor_row_, 'A');
+    pending_ += '\r';
+    append_prompt_line();
+    pending_ += line_;
+    pending_ += "\x1b[J";
+    auto total = prompt_width_ + columns(line_, 0, line_.size());
+    // Leave the pending-wrap state of the last column.
+    if (total > 0 && total % width_ == 0)
+      pending_ += "\r\n";
+    auto end_row = total / width_;
+    auto pos = prompt_width_ + columns(line_, 0, cursor_);
+    auto row = pos / width_;
+    if (end_row > row)
+      csi(end_row - row, 'A');
+    pending_ += '\r';
+    if (pos % width_ > 0)
+      csi(pos % width_, 'C');
+    cursor_row_ = row;
+    wide_ = total >= width_;
+    shown_ = line_;
+    shown_cursor_ = cursor_;
+  }
+
+  // Appends the last line of the prompt.
+  void append_prompt_line()
+  {
+    auto& str = prompt();
+    auto nl = str.rfind('\n');
+    pending_.append(str, nl == std::string::npos ? 0 : nl + 1,
+                    std::string::npos);
+  }
+
+  // Replaces prompt and line with the queued output and draws them again
+  // below, all in a single write.
+  void print_queued()
+  {
+    clear_rows();
+    queue_->take(pending_);
+    redraw();
+  }
+
+  // Draws prompt and line again for the new terminal width. The terminal
+  // may have rewrapped the rows, so this clears from the row of the prompt
+  // as far as known before redrawing.
+  void resize()
+  {
+    winched() = 0;
+    auto width = terminal_width();
+    if (width == width_)
+      return;
+    width_ = width;
+    clear_rows();
+    redraw();
+  }
+
+  // Moves to the start of the prompt and clears everything below.
+  void clear_rows()
+  {
+    if (cursor_row_ > 0)
+      csi(cursor_row_, 'A');
+    pending_ += "\r\x1b[J";
+  }
+
+  // Draws prompt and line after clearing them.
+  void redraw()
+  {
+    if (dynamic_prompt_)
+      prompt_width_ = dynamic_prompt_->width();
+    shown_.clear();
+    shown_cursor_ = 0;
+    cursor_row_ = 0;
+    wide_ = false;
+    // Drawing multiple rows includes the prompt.
+    if (prompt_width_ + columns(line_, 0, line_.size()) < width_)
+      append_prompt_line();
+    render();
+    flush();
+  }
+
+  int in_;
+  int out_;
+  std::string history_filename_;
+  size_t history_size_;
+  bool unique_history_;
+  char comp_key_;
+  std::deque<std::string> history_;
+  size_t history_pos_;
+  std::string saved_;
+  std::string prompt_;
+  std::shared_ptr<dynamic_prompt> dynamic_prompt_;
+  size_t prompt_width_;
+  completer_pointer completer_;
+  std::shared_ptr<output_queue> queue_;
+  termios orig_;
+  struct sigaction orig_winch_;
+  bool raw_;
+  bool editing_;
+  bool eof_;
+  char buf_[256];
+  size_t first_;
+  size_t last_;
+  std::string line_;
+  size_t cursor_;
+  std::string shown_;
+  size_t shown_cursor_;
+  size_t cursor_row_;
+  size_t width_;
+  bool wide_;
+  std::string pending_;
+  io_stats stats_;
+};
+
+} // namespace sash
+
+#endif // SASH_TERMIOS_BACKEND_HPP
@@ -0,0 +1,259 @@
+/******************************************************************************
+ *                   ____     ______   ____     __  __                        *
+ *                  /\  _`\  /\  _  \ /\  _`\  /\ \/\ \                       *
+ *                  \ \,\L\_\\ \ \L\ \\ \,\L\_\\ \ \_\ \                      *
+ *                   \/_\__ \ \ \  __ \\/_\__ \ \ \  _  \                     *
+ *                     /\ \L\ \\ \ \/\ \ /\ \L\ \\ \ \ \ \                    *
+ *                     \ `\____\\ \_\ \_\\ `\____\\ \_\ \_\                   *
+ *                      \/_____/ \/_/\/_/ \/_____/ \/_/\/_/                   *
+ *                                                                            *
+ *                                                                            *
+ * Copyright (c) 2014                                                         *
+ * Matthias Vallentin <vallentin (at) icir.org>                               *
+ * Dominik Charousset <dominik.charousset (at) haw-hamburg.de>                *
+ *                                                                            *
+ * Distributed under the 3-clause BSD License.                                *
+ * See accompanying file LICENSE.                                             *
+\******************************************************************************/
+
+#ifndef SASH_TRACING_HPP
+#define SASH_TRACING_HPP
+
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+#include <ostream>
+
+#include <unistd.h>
+
+namespace sash {
+
+/// A tracing policy that records nothing. Spans are empty objects, i.e.,
+/// the compiler removes all hooks.
+struct null_tracer
+{
+  class span
+  {
+  public:
+    explicit span(char const*)
+    {
+      // nop
+    }
+
+    span(char const*, std::string const&)
+    {
+      // nop
+    }
+  };
+};
+
+/// A completed span.
+struct trace_event
+{
+  /// A static string naming the hook, e.g., `"process"`.
+  char const* name;
+  /// Optional context, e.g., the name of the executed command.
+  std::string detail;
+  /// A small ID of the recording thread, starting at 1.
+  uint32_t tid;
+  /// Start time in nanoseconds since the epoch of the steady clock.
+  int64_t start;
+  /// Duration in nanoseconds.
+  int64_t duration;
+};
+
+/// Collects trace events from all threads up to a fixed capacity and
+/// exports them in the Chrome trace-event format, which chrome://tracing
+/// and Perfetto load for offline analysis.
+class trace_buffer
+{
+  trace_buffer(trace_buffer const&) = delete;
+  trace_buffer& operator=(trace_buffer const&) = delete;
+
+public:
+  explicit trace_buffer(size_t capacity = 1000000)
+    : capacity_{capacity},
+      dropped_{0}
+  {
+    // nop
+  }
+
+  /// Adds an event or drops it if the buffer is full.
+  void add(char const* name, std::string const* detail, int64_t start,
+           int64_t stop)
+  {
+    auto tid = thread_id();
+    std::unique_lock<std::mutex> guard{mtx_};
+    if (events_.size() >= capacity_)
+    {
+      ++dropped_;
+      return;
+    }
+    events_.push_back(trace_event{name, detail ? *detail : std::string{},
+                                  tid, start, stop - start});
+  }
+
+  /// Returns a copy of all recorded events.
+  std::vector<trace_event> events() const
+  {
+    std::unique_lock<std::mutex> guard{mtx_};
+    return events_;
+  }
+
+  /// Returns the number of events dropped due to the capacity limit.
+  size_t dropped() const
+  {
+    std::unique_lock<std::mutex> guard{mtx_};
+    return dropped_;
+  }
+
+  /// Discards all recorded events.
+  void clear()
+  {
+    std::unique_lock<std::mutex> guard{mtx_};
+    events_.clear();
+    dropped_ = 0;
+  }
+
+  /// Writes all recorded events as Chrome trace-event JSON to @p out.
+  void write_chrome_trace(std::ostream& out) const
+  {
+    auto xs = events();
+    auto pid = static_cast<long>(::getpid());
+    char buf[128];
+    out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+    for (size_t i = 0; i < xs.size(); ++i)
+    {
+      auto& x = xs[i];
+      if (i > 0)
+        out << ',';
+      out << "\n{\"name\":";
+      write_json_string(out, x.name);
+      // Timestamps are in microseconds, keep nanosecond precision.
+      std::snprintf(buf, sizeof(buf),
+                    ",\"cat\":\"sash\",\"ph\":\"X\",\"pid\":%ld,\"tid\":%u,"
+                    "\"ts\":%.3f,\"dur\":%.3f",
+                    pid, x.tid, static_cast<double>(x.start) / 1000.,
+                    static_cast<double>(x.duration) / 1000.);
+      out << buf;
+      if (! x.detail.empty())
+      {
+        out << ",\"args\":{\"detail\":";
+        write_json_string(out, x.detail);
+        out << '}';
+      }
+      out << '}';
+    }
+    out << "\n]}\n";
+  }
+
+  /// Returns the current time in nanoseconds.
+  static int64_t now()
+  {
+    using namespace std::chrono;
+    auto t = steady_clock::now().time_since_epoch();
+    return static_cast<int64_t>(duration_cast<nanoseconds>(t).count());
+  }
+
+private:
+  static uint32_t thread_id()
+  {
+    static std::atomic<uint32_t> next{1};
+    static thread_local uint32_t id = next++;
+    return id;
+  }
+
+  static void write_json_string(std::ostream& out, std::string const& str)
+  {
+    out << '"';
+    for (auto c : str)
+    {
+      switch (c)
+      {
+        case '"':
+          out << "\\\"";
+          break;
+        case '\\':
+          out << "\\\\";
+          break;
+        case '\n':
+          out << "\\n";
+          break;
+        case '\t':
+          out << "\\t";
+          break;
+        default:
+          if (static_cast<unsigned char>(c) < 0x20)
+          {
+            char buf[8];
+            std::snprintf(buf, sizeof(buf), "\\u%04x", c);
+            out << buf;
+          }
+          else
+          {
+            out << c;
+          }
+      }
+    }
+    out << '"';
+  }
+
+  size_t capacity_;
+  size_t dropped_;
+  mutable std::mutex mtx_;
+  std::vector<trace_event> events_;
+};
+
+/// A tracing policy that records each span into a process-wide
+/// {@link trace_buffer}, accessible via `recording_tracer::buffer()`.
+struct recording_tracer
+{
+  class span
+  {
+    span(span const&) = delete;
+    span& operator=(span const&) = delete;
+
+  public:
+    explicit span(char const* name)
+      : name_{name},
+        detail_{nullptr},
+        start_{trace_buffer::now()}
+    {
+      // nop
+    }
+
+    /// Constructs a span with context. The span keeps a reference to
+    /// @p detail, i.e., the string must outlive the span.
+    span(char const* name, std::string const& detail)
+      : name_{name},
+        detail_{&detail},
+        start_{trace_buffer::now()}
+    {
+      // nop
+    }
+
+    ~span()
+    {
+      buffer().add(name_, detail_, start_, trace_buffer::now());
+    }
+
+  private:
+    char const* name_;
+    std::string const* detail_;
+    int64_t start_;
+  };
+
+  static trace_buffer& buffer()
+  {
+    static trace_buffer instance;
+    return instance;
+  }
+};
+
+} // namespace sash
+
+#endif // SASH_TRACING_HPP
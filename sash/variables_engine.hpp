@@ -20,15 +20,22 @@
 #define SASH_VARIABLES_ENGINE_HPP
 
 #include <map>
+#include <mutex>
+#include <cctype>
 #include <string>
 #include <memory>
+#include <sstream>
 #include <iterator>
 #include <algorithm>
+#include <functional>
+
+#include "sash/preprocessor_chain.hpp"
 
 namespace sash {
 
 /// An example implementation for a variables engine that is
-/// convertible to a std::function object.
+/// convertible to a std::function object. All member functions are
+/// thread-safe.
 template<typename Container = std::map<std::string, std::string>>
 class variables_engine
   : public std::enable_shared_from_this<variables_engine<Container>>
@@ -68,7 +75,7 @@ public:
     raii_error_string scoped_err{err};
     auto set_error = [&]() -> std::ostream&
     {
-      return scoped_err.oss << "syntax error at position "
+      return scoped_err.stream() << "syntax error at position "
                             << std::to_string(std::distance(in.begin(), i))
                             << ": ";
     };
@@ -108,8 +115,10 @@ public:
             // else:: fall through
           case read_variable:
             std::string varname(pos, i);
+            std::unique_lock<std::mutex> guard{mtx_};
             auto j = variables_.find(varname);
-            out += j == variables_.end() ? "" : j->second;
+            if (j != variables_.end())
+              out += j->second;
             state = traverse;
             if (state == read_braced_variable)
               pos = i + 1;
@@ -136,6 +145,7 @@ public:
               out.clear();
               // our value can in turn have variables
               parse(err, val_input, value, true);
+              std::unique_lock<std::mutex> guard{mtx_};
               if (err.empty())
                 variables_.insert(std::make_pair(std::move(key),
                                                  std::move(value)));
@@ -190,21 +200,69 @@ public:
     flush();
   }
 
+  /// Parses an input line like {@link parse}, but reports lines without
+  /// variables and assignments as unchanged instead of copying them.
+  preprocess_result preprocess(std::string& err, const std::string& in,
+                               std::string& out)
+  {
+    auto eq = in.find('=');
+    auto assignment = eq != std::string::npos && eq > 0
+                      && std::all_of(in.begin(),
+                                     in.begin() + static_cast<ptrdiff_t>(eq),
+                                     [](char c)
+                                     {
+                                       return std::isalnum(c) || c == '_';
+                                     });
+    if (! assignment && in.find('$') == std::string::npos)
+      return line_unchanged;
+    parse(err, in, out);
+    return out.empty() ? line_consumed : line_changed;
+  }
+
+  /// A stage for a {@link preprocessor_chain}.
+  class stage
+  {
+  public:
+    explicit stage(std::shared_ptr<variables_engine> ptr)
+      : ptr_{std::move(ptr)}
+    {
+      // nop
+    }
+
+    preprocess_result operator()(std::string& err, const std::string& in,
+                                 std::string& out) const
+    {
+      return ptr_->preprocess(err, in, out);
+    }
+
+  private:
+    std::shared_ptr<variables_engine> ptr_;
+  };
+
+  /// Creates a {@link stage} from this implementation.
+  stage as_stage()
+  {
+    return stage{this->shared_from_this()};
+  }
+
   /// Sets a variable to given value.
   void set(const std::string& identifier, std::string value)
   {
+    std::unique_lock<std::mutex> guard{mtx_};
     variables_[identifier] = std::move(value);
   }
 
   /// Unsets a variable.
   void unset(const std::string& identifier)
   {
+    std::unique_lock<std::mutex> guard{mtx_};
     variables_.erase(identifier);
   }
 
   /// Gets a content of a variable.
   std::string get(const std::string& identifier)
   {
+    std::unique_lock<std::mutex> guard{mtx_};
     auto i = variables_.find(identifier);
     return i != variables_.end() ? i->second : std::string{};
   }
@@ -245,14 +303,24 @@ private:
     ~raii_error_string()
     {
       // leave err untouched if no error occured
-      auto str = oss.str();
+      if (! oss)
+        return;
+      auto str = oss->str();
       if (! str.empty())
         err = std::move(str);
     }
-    std::ostringstream oss;
+    // Constructing a stream is expensive, hence we only do it on errors.
+    std::ostringstream& stream()
+    {
+      if (! oss)
+        oss.reset(new std::ostringstream);
+      return *oss;
+    }
+    std::unique_ptr<std::ostringstream> oss;
     std::string& err;
   };
 
+  std::mutex mtx_;
   Container variables_;
 };
 
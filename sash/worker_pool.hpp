@@ -0,0 +1,109 @@
+/******************************************************************************
+ *                   ____     ______   ____     __  __                        *
+ *                  /\  _`\  /\  _  \ /\  _`\  /\ \/\ \                       *
+ *                  \ \,\L\_\\ \ \L\ \\ \,\L\_\\ \ \_\ \                      *
+ *                   \/_\__ \ \ \  __ \\/_\__ \ \ \  _  \                     *
+ *                     /\ \L\ \\ \ \/\ \ /\ \L\ \\ \ \ \ \                    *
+ *                     \ `\____\\ \_\ \_\\ `\____\\ \_\ \_\                   *
+ *                      \/_____/ \/_/\/_/ \/_____/ \/_/\/_/                   *
+ *                                                                            *
+ *                                                                            *
+ * Copyright (c) 2014                                                         *
+ * Matthias Vallentin <vallentin (at) icir.org>                               *
+ * Dominik Charousset <dominik.charousset (at) haw-hamburg.de>                *
+ *                                                                            *
+ * Distributed under the 3-clause BSD License.                                *
+ * See accompanying file LICENSE.                                             *
+\******************************************************************************/
+
+#ifndef SASH_WORKER_POOL_HPP
+#define SASH_WORKER_POOL_HPP
+
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <condition_variable>
+
+namespace sash {
+
+/// A fixed-size pool of threads executing tasks in FIFO order.
+class worker_pool
+{
+  worker_pool(worker_pool const&) = delete;
+  worker_pool& operator=(worker_pool const&) = delete;
+
+public:
+  /// The type of a task.
+  using task = std::function<void ()>;
+
+  /// Starts @p num_workers threads, or one thread per core if
+  /// @p num_workers is 0.
+  explicit worker_pool(size_t num_workers = 0)
+    : running_{true}
+  {
+    if (num_workers == 0)
+      num_workers = std::max(std::thread::hardware_concurrency(), 1u);
+    for (size_t i = 0; i < num_workers; ++i)
+      workers_.emplace_back([this] { run(); });
+  }
+
+  /// Discards all tasks that did not start yet and waits for running tasks.
+  ~worker_pool()
+  {
+    {
+      std::unique_lock<std::mutex> guard{mtx_};
+      running_ = false;
+      tasks_.clear();
+    }
+    cv_.notify_all();
+    for (auto& t : workers_)
+      t.join();
+  }
+
+  /// Enqueues a task.
+  void submit(task f)
+  {
+    {
+      std::unique_lock<std::mutex> guard{mtx_};
+      tasks_.push_back(std::move(f));
+    }
+    cv_.notify_one();
+  }
+
+  /// Returns the number of worker threads.
+  size_t size() const
+  {
+    return workers_.size();
+  }
+
+private:
+  void run()
+  {
+    for (;;)
+    {
+      task f;
+      {
+        std::unique_lock<std::mutex> guard{mtx_};
+        cv_.wait(guard, [&] { return ! running_ || ! tasks_.empty(); });
+        if (! running_)
+          return;
+        f = std::move(tasks_.front());
+        tasks_.pop_front();
+      }
+      f();
+    }
+  }
+
+  bool running_;
+  std::mutex mtx_;
+  std::condition_variable cv_;
+  std::deque<task> tasks_;
+  std::vector<std::thread> workers_;
+};
+
+} // namespace sash
+
+#endif // SASH_WORKER_POOL_HPP